@@ -0,0 +1,288 @@
+// 词法分析和语法分析的基准测试
+// 用种子生成输入，分阶段测量：
+//   lex        词法分析，只取出 token
+//   lex_table  词法分析，登记符号并存进列式 token 表
+//   lalr       整个类 C 源文件的 LALR(1) 分析
+//   expr_deep  parser() 分析括号嵌套很深的表达式
+//   expr_long  parser() 分析很长的表达式
+// 每个阶段重复若干次取最快的一次，给出 MB/s、tokens/s、reductions/s，
+// 以及最后一次的内存分配次数、分配字节数和这个阶段的峰值 RSS。
+// 结果按 "阶段 指标 值" 每行一项写到文件；给出 --baseline 时与保存的结果比较，
+// 吞吐量下降或分配、内存增加超过容差的都是退化，有退化时返回 1。
+// 用法: bench [--size MB] [--seed N] [--repeat N] [--depth N] [--operands N] [--grammar FILE]
+//             [--out FILE] [--baseline FILE] [--tolerance 0.1]
+//       bench --generate c|deep|long FILE     只把生成的输入写到文件
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "../lab1/texer.h"
+#include "../lab2/parser.h"
+#include "corpus.h"
+
+using namespace std;
+typedef chrono::steady_clock timer;
+
+// 全局的分配计数，替换默认的 operator new
+// GCC 把 delete 内联之后会把 free 与 operator new 配对报警告，替换的分配函数本来就成对
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+static atomic<uint64_t> alloc_count{0}, alloc_bytes{0};
+
+void* operator new(size_t size) {
+	alloc_count.fetch_add(1, memory_order_relaxed);
+	alloc_bytes.fetch_add(size, memory_order_relaxed);
+	if(void* p = malloc(size ? size : 1))
+		return p;
+	throw bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// 把峰值 RSS 重置为当前值，内核不支持时什么也不做，峰值就是进程开始以来的
+void reset_peak_rss() {
+	ofstream ofs("/proc/self/clear_refs");
+	if(ofs)
+		ofs << "5";
+}
+
+// 峰值 RSS，KB
+uint64_t peak_rss_kb() {
+	ifstream ifs("/proc/self/status");
+	string line;
+	while(getline(ifs, line))
+		if(line.compare(0, 6, "VmHWM:") == 0)
+			return stoull(line.substr(6));
+	rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+struct phase_result {
+	string name;
+	double seconds;
+	uint64_t bytes, tokens, reductions;
+	uint64_t allocs, alloc_bytes, rss_kb;
+};
+
+// 运行 repeat 次 run，取最快的一次；run 返回处理的 token 数，规约数从 work.reductions 得到
+template<class F>
+phase_result measure(const string& name, uint64_t bytes, int repeat, F&& run) {
+	phase_result r{name, 1e300, bytes, 0, 0, 0, 0, 0};
+	reset_peak_rss();
+	for(int i = 0; i < repeat; ++i) {
+		uint64_t a0 = alloc_count, b0 = alloc_bytes, red0 = work.reductions;
+		auto t0 = timer::now();
+		r.tokens = run();
+		double s = chrono::duration<double>(timer::now() - t0).count();
+		r.seconds = min(r.seconds, s);
+		r.allocs = alloc_count - a0;
+		r.alloc_bytes = alloc_bytes - b0;
+		r.reductions = work.reductions - red0;
+	}
+	r.rss_kb = peak_rss_kb();
+	return r;
+}
+
+// 每个阶段的指标，吞吐量越大越好，其余越小越好
+typedef map<string, map<string, double>> results;
+
+bool higher_is_better(const string& metric) {
+	return metric.size() > 2 && metric.compare(metric.size() - 2, 2, "_s") == 0;
+}
+
+void add_metrics(results& res, const phase_result& r) {
+	map<string, double>& m = res[r.name];
+	m["seconds"] = r.seconds;
+	if(r.bytes)
+		m["mb_s"] = r.bytes / r.seconds / 1e6;
+	m["tokens_s"] = r.tokens / r.seconds;
+	if(r.reductions)
+		m["reductions_s"] = r.reductions / r.seconds;
+	m["allocs"] = r.allocs;
+	m["alloc_bytes"] = r.alloc_bytes;
+	m["peak_rss_kb"] = r.rss_kb;
+}
+
+void write_results(ostream& os, const results& res) {
+	os.precision(10);
+	for(auto& [phase, m] : res)
+		for(auto& [metric, v] : m)
+			os << phase << '\t' << metric << '\t' << v << cr;
+}
+
+bool read_results(const string& path, results& res) {
+	ifstream ifs(path);
+	if(!ifs)
+		return false;
+	string phase, metric;
+	double v;
+	while(ifs >> phase >> metric >> v)
+		res[phase][metric] = v;
+	return true;
+}
+
+// 与基线比较，输出每个指标的变化，返回退化的个数；耗时随吞吐量变化，不单独比较
+int compare(const results& base, const results& cur, double tolerance) {
+	int regressions = 0;
+	for(auto& [phase, m] : cur) {
+		auto bp = base.find(phase);
+		if(bp == base.end())
+			continue;
+		for(auto& [metric, v] : m) {
+			auto bm = bp->second.find(metric);
+			if(metric == "seconds" || bm == bp->second.end())
+				continue;
+			double b = bm->second;
+			bool worse = higher_is_better(metric) ? v < b * (1 - tolerance) : v > b * (1 + tolerance) && v > b + 16;
+			double change = b ? (v - b) / b * 100 : 0;
+			cout << (worse ? "REGRESSION " : "           ") << phase << ' ' << metric << ": " << b << " -> " << v
+				 << " (" << (change >= 0 ? "+" : "") << change << "%)" << cr;
+			regressions += worse;
+		}
+	}
+	return regressions;
+}
+
+// 把一段文本分析成 token 表，表引用 tx 的缓冲区
+bool lex_into(texer& tx, const string& text, token_table& table) {
+	tx.use_symbols(&symbols);
+	tx.init(text.data(), text.size(), 0, false, false);
+	table.clear();
+	return tx.get_tokens(table) == 0;
+}
+
+int main(int argc, char* argv [ ]) {
+	size_t mb = 8, depth = 1000, operands = 4096;
+	uint32_t seed = 12345;
+	int repeat = 5;
+	double tolerance = 0.1;
+	string grammar_path = "../lab2/statement.grammar", out_path = "bench_results.txt", baseline_path;
+	string generate_kind, generate_path;
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if(arg == "--generate" && i + 2 < argc) {
+			generate_kind = argv[++i];
+			generate_path = argv[++i];
+			continue;
+		}
+		if(i + 1 >= argc) {
+			cout << "Unknown argument " << arg << cr;
+			return 1;
+		}
+		if(arg == "--size") mb = stoul(argv[++i]);
+		else if(arg == "--seed") seed = stoul(argv[++i]);
+		else if(arg == "--repeat") repeat = max(1, stoi(argv[++i]));
+		else if(arg == "--depth") depth = stoul(argv[++i]);
+		else if(arg == "--operands") operands = stoul(argv[++i]);
+		else if(arg == "--grammar") grammar_path = argv[++i];
+		else if(arg == "--out") out_path = argv[++i];
+		else if(arg == "--baseline") baseline_path = argv[++i];
+		else if(arg == "--tolerance") tolerance = stod(argv[++i]);
+		else {
+			cout << "Unknown argument " << arg << cr;
+			return 1;
+		}
+	}
+
+	// 所有参数都读完再生成，--size、--seed 等写在 --generate 之后也有效
+	if(!generate_path.empty()) {
+		ofstream ofs(generate_path, ios::out | ios::binary);
+		corpus gen(seed);
+		string text = generate_kind == "deep" ? gen.deep_expressions(mb << 20, depth)
+			: generate_kind == "long" ? gen.long_expressions(mb << 20, operands) : gen.c_source(mb << 20);
+		ofs << text;
+		return ofs ? 0 : 1;
+	}
+
+	grammer_init();
+	if(!lalr_init(grammar_path))
+		return 1;
+	trace.set_level(trace_none);
+
+	corpus gen(seed);
+	string source = gen.c_source(mb << 20);
+	string deep = gen.deep_expressions(mb << 20, depth);
+	string wide = gen.long_expressions(mb << 20, operands);
+	vector<phase_result> phases;
+
+	phases.push_back(measure("lex", source.size(), repeat, [&] {
+		texer tx;
+		tx.init(source.data(), source.size(), 0, false, false);
+		token tk;
+		uint64_t n = 0;
+		while(tx.next_token(tk))
+			++n;
+		return n;
+	}));
+
+	texer source_tx;
+	token_table source_tokens(symbols);
+	phases.push_back(measure("lex_table", source.size(), repeat, [&] {
+		lex_into(source_tx, source, source_tokens);
+		return uint64_t(source_tokens.size());
+	}));
+
+	int failed = 0;
+	phases.push_back(measure("lalr", 0, repeat, [&] {
+		src.attach(&source_tokens);
+		failed += parse_program() < 0;
+		return uint64_t(source_tokens.size());
+	}));
+
+	texer expr_tx;
+	token_table expr_tokens(symbols);
+	for(auto [name, text] : {pair<const char*, const string*>("expr_deep", &deep), {"expr_long", &wide}}) {
+		if(!lex_into(expr_tx, *text, expr_tokens)) {
+			cout << name << ": lexical error in the generated input" << cr;
+			return 1;
+		}
+		phases.push_back(measure(name, 0, repeat, [&] {
+			src.attach(&expr_tokens);
+			failed += parse_assignments();
+			return uint64_t(expr_tokens.size());
+		}));
+	}
+	if(failed) {
+		cout << failed << " inputs failed to parse" << cr;
+		return 1;
+	}
+
+	results res;
+	for(const phase_result& r : phases) {
+		add_metrics(res, r);
+		cout << r.name << ": " << r.seconds * 1e3 << " ms";
+		if(r.bytes)
+			cout << ", " << r.bytes / r.seconds / 1e6 << " MB/s";
+		cout << ", " << r.tokens / r.seconds / 1e6 << " M tokens/s";
+		if(r.reductions)
+			cout << ", " << r.reductions / r.seconds / 1e6 << " M reductions/s";
+		cout << ", " << r.allocs << " allocs (" << r.alloc_bytes << " bytes), peak RSS " << r.rss_kb << " KB" << cr;
+	}
+
+	ofstream ofs(out_path);
+	write_results(ofs, res);
+	if(!ofs) {
+		cout << "Cannot write " << out_path << cr;
+		return 1;
+	}
+	if(baseline_path.empty())
+		return 0;
+	results base;
+	if(!read_results(baseline_path, base)) {
+		cout << "Cannot open " << baseline_path << cr;
+		return 1;
+	}
+	int regressions = compare(base, res, tolerance);
+	cout << regressions << " regressions" << cr;
+	return regressions ? 1 : 0;
+}
@@ -0,0 +1,188 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 基准测试用的合成输入，同一个种子总是生成相同的文本
+// 类 C 源文件只用词法分析器认识的算符，能被 statement.grammar 整个分析；
+// 两种表达式输入每行一个赋值语句，右侧是普通的算术表达式，只在改变结合次序时加括号。
+// 变量名不用文法中的终结符 i。
+
+class corpus {
+	mt19937 rng;
+	string out;
+
+	static constexpr const char* names[] = {"sum", "count", "tmp", "value", "index", "x1", "y2", "total",
+		"a", "b", "c", "n", "k", "left", "right", "acc"};
+	static constexpr size_t name_count = sizeof(names) / sizeof(names[0]);
+
+	size_t pick(size_t n) { return rng() % n; }
+	void name() { out += names[pick(name_count)]; }
+	void number() { out += to_string(pick(1000)); }
+	void operand() { pick(3) ? name() : number(); }
+	void indent(int depth) { out.append(depth * 4, ' '); }
+
+	// 语句文法中的表达式，层数有限
+	void expr(int depth) {
+		int terms = 1 + pick(3);
+		for(int t = 0; t < terms; ++t) {
+			if(t) out += pick(2) ? " + " : " * ";
+			if(depth > 0 && pick(4) == 0) {
+				out += '(';
+				expr(depth - 1);
+				out += ')';
+			}
+			else
+				operand();
+		}
+	}
+
+	void statement(int depth, size_t& labels);
+
+	// 有 n 个运算对象的平衡表达式，用显式的栈
+	// 加法左结合，只有作为右运算对象的加法要套括号，例如 a+b+(c+d)
+	void balanced(size_t n) {
+		vector<pair<size_t, bool>> todo(1, {n, false});		// (运算对象个数, 是否加括号)
+		while(!todo.empty()) {
+			auto [k, paren] = todo.back();
+			todo.pop_back();
+			if(k == 0)
+				out += ')';
+			else if(k == ~size_t(0))
+				out += '+';
+			else if(k == 1)
+				operand();
+			else {
+				size_t a = 1 + pick(k - 1);
+				if(paren) {
+					out += '(';
+					todo.emplace_back(0, false);
+				}
+				todo.emplace_back(k - a, true);
+				todo.emplace_back(~size_t(0), false);
+				todo.emplace_back(a, false);
+			}
+		}
+	}
+
+public:
+	explicit corpus(uint32_t seed) : rng(seed) {}
+
+	// 类 C 源文件，由若干个函数组成，含声明、赋值、条件、跳转、调用、标签和注释，不少于 bytes 字节
+	string c_source(size_t bytes) {
+		out = "/* generated source */\n#include <stdio.h>\n";
+		size_t labels = 0;
+		for(size_t f = 0; out.size() < bytes; ++f) {
+			out += "int f" + to_string(f) + "() {\n";
+			int stmts = 4 + pick(12);
+			for(int s = 0; s < stmts; ++s)
+				statement(1, labels);
+			out += "    return ";
+			expr(2);
+			out += ";\n}\n";
+		}
+		return move(out);
+	}
+
+	// 每行一个赋值，右侧的加法向左嵌套 depth 层：((((a+b)+c)+d)...)，再乘一个运算对象
+	string deep_expressions(size_t bytes, size_t depth) {
+		out.clear();
+		while(out.size() < bytes) {
+			name();
+			out += '=';
+			out.append(depth, '(');
+			operand();
+			for(size_t d = 0; d < depth; ++d) {
+				out += '+';
+				operand();
+				out += ')';
+			}
+			out += '*';
+			operand();
+			out += ";\n";
+		}
+		return move(out);
+	}
+
+	// 每行一个赋值，右侧是有 operands 个运算对象的平衡表达式
+	string long_expressions(size_t bytes, size_t operands) {
+		out.clear();
+		while(out.size() < bytes) {
+			name();
+			out += '=';
+			balanced(operands);
+			out += ";\n";
+		}
+		return move(out);
+	}
+};
+
+inline void corpus::statement(int depth, size_t& labels) {
+	indent(depth);
+	switch(pick(depth < 4 ? 10 : 7)) {
+	case 0:
+		out += "int ";
+		name();
+		out += " = ";
+		expr(2);
+		out += ";\n";
+		break;
+	case 1:
+	case 2:
+	case 3:
+		name();
+		out += " = ";
+		expr(3);
+		out += pick(4) ? ";" : "";
+		out += pick(5) ? "\n" : "    // update\n";
+		break;
+	case 4:
+		out += "printf(\"value %d\\n\", ";
+		name();
+		out += ");\n";
+		break;
+	case 5:
+		out += "l" + to_string(labels) + ":\n";
+		indent(depth);
+		name();
+		out += " = ";
+		expr(1);
+		out += ";\n";
+		indent(depth);
+		out += "goto l" + to_string(labels++) + ";\n";
+		break;
+	case 6:
+		out += "/* block comment\n";
+		indent(depth);
+		out += "   over two lines */\n";
+		break;
+	default: {
+		const char* relops[] = {" < ", " > ", " <= ", " >= ", " == "};
+		out += "if (";
+		expr(1);
+		out += relops[pick(5)];
+		expr(1);
+		out += ") {\n";
+		int stmts = 1 + pick(4);
+		for(int s = 0; s < stmts; ++s)
+			statement(depth + 1, labels);
+		indent(depth);
+		out += "}\n";
+		if(pick(2)) {
+			indent(depth);
+			out += "else {\n";
+			statement(depth + 1, labels);
+			indent(depth);
+			out += "}\n";
+		}
+		break;
+	}
+	}
+}
+
+#endif
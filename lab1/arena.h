@@ -0,0 +1,70 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// 顺序分配的内存池
+// 分配只移动指针，单个对象不能释放，reset 一次性丢掉全部内容。
+// reset 保留第一块，同样大小的工作量反复使用时不再向系统要内存。
+// 只放平凡类型，不调用析构函数。
+class arena {
+	static constexpr size_t block_size = 1 << 20;
+
+	std::vector<std::unique_ptr<char[]>> blocks;
+	std::vector<size_t> sizes;
+	char* cur;
+	size_t left;
+	size_t used;			// 已分配的字节数
+
+	void next_block(size_t bytes) {
+		size_t size = std::max(block_size, bytes);
+		blocks.emplace_back(new char[size]);
+		sizes.emplace_back(size);
+		cur = blocks.back().get();
+		left = size;
+	}
+
+public:
+	arena() : cur(nullptr), left(0), used(0) {}
+	arena(const arena&) = delete;
+	arena& operator = (const arena&) = delete;
+
+	void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+		size_t pad = (align - uintptr_t(cur) % align) % align;
+		if ( pad + bytes > left ) {
+			next_block(bytes + align);
+			pad = (align - uintptr_t(cur) % align) % align;
+		}
+		char* p = cur + pad;
+		cur += pad + bytes, left -= pad + bytes;
+		used += bytes;
+		return p;
+	}
+
+	template<class T>
+	T* allocate_array(size_t n) {
+		return (T*)allocate(n * sizeof(T), alignof(T));
+	}
+
+	// 丢掉全部内容，只留下第一块
+	void reset() {
+		if ( blocks.empty() ) return;
+		blocks.resize(1);
+		sizes.resize(1);
+		cur = blocks[0].get();
+		left = sizes[0];
+		used = 0;
+	}
+
+	size_t allocated() const { return used; }
+	size_t reserved() const {
+		size_t res = 0;
+		for ( size_t s : sizes ) res += s;
+		return res;
+	}
+};
+
+#endif
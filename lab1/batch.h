@@ -0,0 +1,413 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "texer.h"
+#include "thread_pool.h"
+#include "token_cache.h"
+using namespace std;
+
+// 批量词法分析和单个大文件的并行词法分析
+// 每个文件是一个任务，交给工作窃取线程池；大文件再在行边界切成若干段，各段单独成为任务。
+// 段的起始状态只有两种：在块注释外或块注释内（字符串不跨行，续行不跨段），
+// 所以每段在两种起始状态下都推测分析一遍。全部段完成后从第一段开始沿实际状态
+// 依次选出正确的结果，再并行把各段格式化成文本，最后按顺序写出。
+// 给了磁盘缓存时先按内容查缓存，命中的文件不分析，缓存的 token 流同样分段格式化后写出。
+// 有预处理指令的文件要先预处理，宏和条件编译跨越整个文件，不能切段，整个文件由一个线程顺序分析，
+// 结果和单独分析这个文件相同。
+
+struct batch_options {
+	string out_dir = "tokens";		// 每个文件的结果写到这个目录下
+	size_t threads = 0;				// 0 表示按 CPU 核数
+	size_t chunk_bytes = 4 << 20;	// 超过这个大小的文件切段
+	bool binary = false;			// 输出二进制 token 流
+	size_t max_errors = 0;			// 不为 0 时用恢复模式分析，每个文件最多报告这么多个非法单词
+	keyword_view keywords = builtin_keywords.view();
+	token_cache* cache = nullptr;	// 不为空时先查磁盘缓存，没命中的文件分析完存进去
+	vector<string> include_dirs;	// 预处理时 #include 的查找目录
+};
+
+// 一段在某个起始状态下的分析结果
+struct lex_result {
+	bool done = false;
+	bool end_comment;			// 分析完后是否仍在块注释内
+	bool failed;
+	unique_ptr<texer> tx;		// 续行拼接出的单词归它所有，写出前要留着
+	vector<token> tokens;
+	ostringstream errors;
+};
+
+// 文件中的一段完整的行
+struct lex_chunk {
+	size_t begin, end;			// 在文件中的字节范围
+	size_t first_row;
+	lex_result result[2];		// 下标是起始状态：0 在块注释外，1 在块注释内
+	int state;					// 拼接时确定的实际起始状态
+	string text;				// 格式化好的文本输出
+};
+
+struct lex_file {
+	string path, out_path;
+	source_buffer buf;
+	vector<unique_ptr<lex_chunk>> chunks;
+	atomic<size_t> remaining;
+	size_t used = 0;			// 出错时只写出前 used 段
+	size_t tokens = 0;
+	bool failed = false;
+	bool label = true;			// 错误信息前加上文件名
+	bool expanded = false;		// 有预处理指令，整个文件预处理后顺序分析
+	uint64_t key = 0;			// 在缓存中的键
+	bool hit = false;
+	token_file cached;			// 命中缓存时 token 的值指向这里
+};
+
+// 按给定的起始状态分析一段，如果给了 other（另一种起始状态的结果），
+// 一旦某个 token 的起点和 other 中的某个 token 相同，之后的结果必然一样，直接复制
+// 恢复模式下非法单词都留在 tokens 中，出错的段也照常拼接，写出时再从 tokens 中报告
+inline void lex_range(const lex_file& f, lex_chunk& c, int comment, const batch_options& opt, const lex_result* other = nullptr) {
+	lex_result& r = c.result[comment];
+	r.tx.reset(new texer);
+	r.tx->use_keywords(opt.keywords);
+	if ( opt.max_errors ) r.tx->recover(0);
+	r.errors.str("");
+	r.tx->error_stream(r.errors);
+	r.tx->init(f.buf.begin() + c.begin, c.end - c.begin, c.first_row, comment, c.end < size_t(f.buf.end() - f.buf.begin()));
+	r.tokens.clear();
+	size_t k = 0;
+	for ( const token& tk : *r.tx ) {
+		if ( other ) {
+			const vector<token>& o = other->tokens;
+			while ( k < o.size() && (o[k].row < tk.row || (o[k].row == tk.row && o[k].col < tk.col)) ) ++k;
+			if ( k < o.size() && o[k].row == tk.row && o[k].col == tk.col ) {
+				r.tokens.insert(r.tokens.end(), o.begin() + k, o.end());
+				r.end_comment = other->end_comment;
+				r.failed = other->failed;
+				r.errors << other->errors.str();
+				r.done = true;
+				return;
+			}
+		}
+		r.tokens.emplace_back(tk);
+	}
+	r.end_comment = r.tx->comment_open();
+	r.failed = !r.tx->ok() && !opt.max_errors;
+	r.done = true;
+}
+
+// 在两种起始状态下分析一段
+inline void speculate(const lex_file& f, lex_chunk& c, const batch_options& opt) {
+	lex_range(f, c, 0, opt);
+	if ( c.begin > 0 ) lex_range(f, c, 1, opt, &c.result[0]);
+}
+
+// 在行边界把文件切成大约 chunk_bytes 大小的段
+inline void split_file(lex_file& f, size_t chunk_bytes) {
+	const char* data = f.buf.begin();
+	size_t size = f.buf.end() - data;
+	size_t begin = 0;
+	while ( begin < size ) {
+		size_t end = size;
+		if ( size - begin > chunk_bytes ) {
+			end = split_point(data, begin, begin + chunk_bytes);
+			// 这一段内没有可以切分的位置时，向后找第一个
+			if ( end == begin ) {
+				end = begin + chunk_bytes;
+				while ( end < size ) {
+					const void* nl = memchr(data + end, cr, size - end);
+					end = nl ? (const char*)nl - data + 1 : size;
+					if ( split_point(data, end - 1, end) == end ) break;
+				}
+			}
+		}
+		unique_ptr<lex_chunk> c(new lex_chunk);
+		c->begin = begin, c->end = end;
+		c->first_row = f.buf.row_of(begin);
+		f.chunks.emplace_back(move(c));
+		begin = end;
+	}
+}
+
+class batch_lexer {
+	batch_options opt;
+	vector<unique_ptr<lex_file>> files;
+	atomic<size_t> total_tokens, total_bytes, failed_files;
+	mutex out_m;
+
+	// 各段都完成后，从第一段开始沿实际状态选出每段的结果
+	void stitch(thread_pool& pool, lex_file& f) {
+		int comment = 0;
+		for ( auto& c : f.chunks ) {
+			c->state = comment;
+			if ( !c->result[comment].done ) lex_range(f, *c, comment, opt);
+			const lex_result& r = c->result[comment];
+			++f.used;
+			f.tokens += r.tokens.size();
+			comment = r.end_comment;
+			if ( r.failed ) {
+				f.failed = true;
+				break;
+			}
+		}
+		if ( opt.binary ) {
+			write(f);
+			return;
+		}
+		// 文本格式化比分析本身还慢，各段并行做
+		f.remaining = f.used;
+		for ( size_t k = 1; k < f.used; ++k ) {
+			lex_chunk* c = f.chunks[k].get();
+			pool.submit([this, &f, c]() { format(f, *c); });
+		}
+		format(f, *f.chunks[0]);
+	}
+
+	void format(lex_file& f, lex_chunk& c) {
+		HOT_SCOPE(hp_format);
+		const vector<token>& tokens = c.result[c.state].tokens;
+		c.text.reserve(tokens.size() * 24);
+		for ( const token& tk : tokens )
+			tk.append_to(c.text);
+		if ( --f.remaining == 0 ) write(f);
+	}
+
+	void write(lex_file& f) {
+		filesystem::path dir = filesystem::path(f.out_path).parent_path();
+		if ( !dir.empty() ) filesystem::create_directories(dir);
+		if ( opt.binary ) {
+			token_writer writer;
+			writer.open(f.out_path);
+			for ( size_t k = 0; k < f.used; ++k ) {
+				lex_chunk& c = *f.chunks[k];
+				HOT_SCOPE(hp_format);
+				for ( const token& tk : c.result[c.state].tokens )
+					writer.add(tk.row, tk.col, tk.type, tk.value);
+			}
+		}
+		else {
+			ofstream ofs = ofstream(f.out_path, ios::out | ios::binary);
+			for ( size_t k = 0; k < f.used; ++k )
+				ofs.write(f.chunks[k]->text.data(), f.chunks[k]->text.size());
+		}
+		total_tokens += f.tokens;
+		total_bytes += f.buf.end() - f.buf.begin();
+		if ( f.failed ) {
+			++failed_files;
+			lex_chunk& c = *f.chunks[f.used - 1];
+			lock_guard<mutex> lock(out_m);
+			// 预处理过的文件可能有多条错误，每条前面都加上文件名
+			if ( f.label ) {
+				istringstream errors(c.result[c.state].errors.str());
+				for ( string line; getline(errors, line); ) cout << f.path << ": " << line << cr;
+			}
+			else cout << c.result[c.state].errors.str();
+		}
+		if ( opt.max_errors ) report(f);
+		if ( opt.cache && !f.hit && !f.failed ) store(f);
+		f.chunks.clear();
+		f.cached.close();
+		f.buf.release();
+	}
+
+	void store(const lex_file& f) {
+		auto fill = [&](token_writer& writer) {
+			for ( size_t k = 0; k < f.used; ++k ) {
+				const lex_chunk& c = *f.chunks[k];
+				for ( const token& tk : c.result[c.state].tokens )
+					writer.add(tk.row, tk.col, tk.type, tk.value);
+			}
+		};
+		if ( f.expanded ) opt.cache->store(f.key, f.chunks[0]->result[0].tx->dependencies(), fill);
+		else opt.cache->store(f.key, fill);
+	}
+
+	// 命中缓存：token 流按个数分段，当作已经分析好的结果，之后和分析出的一样写出
+	void reuse(thread_pool& pool, lex_file& f) {
+		const token_file& tf = f.cached;
+		const uint32_t per = max<size_t>(opt.chunk_bytes / 8, 1);	// 平均每个 token 连同空白大约 8 字节
+		for ( uint32_t i = 0; i < tf.tokens(); i += per ) {
+			unique_ptr<lex_chunk> c(new lex_chunk);
+			lex_result& r = c->result[0];
+			uint32_t end = min<uint64_t>(uint64_t(i) + per, tf.tokens());
+			r.tokens.reserve(end - i);
+			for ( uint32_t k = i; k < end; ++k ) {
+				const token_record& rec = tf[k];
+				r.tokens.emplace_back(rec.row, rec.col, token_type(rec.type), tf.value(k));
+			}
+			r.end_comment = r.failed = false;
+			r.done = true;
+			f.chunks.emplace_back(move(c));
+		}
+		f.remaining = f.chunks.size();
+		if ( f.chunks.empty() ) write(f);
+		else stitch(pool, f);
+	}
+
+	// 恢复模式下报告文件中的非法单词，超出上限的只给出个数
+	// 预处理过的文件由预处理器报告，已经在 errors 中
+	void report(const lex_file& f) {
+		if ( f.expanded ) return;
+		size_t errors = 0;
+		ostringstream out;
+		for ( size_t k = 0; k < f.used; ++k ) {
+			lex_chunk& c = *f.chunks[k];
+			for ( const token& tk : c.result[c.state].tokens ) {
+				if ( tk.type != invalid || errors++ >= opt.max_errors ) continue;
+				if ( f.label ) out << f.path << ": ";
+				write_diagnostic(out, tk.row, tk.col, tk.value.substr(0, texer::max_diagnostic_text));
+			}
+		}
+		if ( errors == 0 ) return;
+		++failed_files;
+		lock_guard<mutex> lock(out_m);
+		cout << out.str();
+		if ( errors > opt.max_errors ) cout << errors - opt.max_errors << " more errors not shown" << cr;
+	}
+
+	void start(thread_pool& pool, lex_file& f) {
+		if ( !f.buf.map(f.path) ) {
+			ifstream ifs = ifstream(f.path, ios::in | ios::binary);
+			if ( !ifs ) {
+				++failed_files;
+				lock_guard<mutex> lock(out_m);
+				cout << "Cannot open " << f.path << cr;
+				return;
+			}
+			f.buf.load(ifs);
+		}
+		f.expanded = pp_has_directives(f.buf);
+		if ( opt.cache ) {
+			size_t size = f.buf.end() - f.buf.begin();
+			f.key = f.expanded ? opt.cache->key(f.buf.begin(), size, token_cache::include_context(f.path, opt.include_dirs))
+							   : opt.cache->key(f.buf.begin(), size);
+			if ( (f.hit = opt.cache->find(f.key, f.cached, f.expanded)) ) {
+				reuse(pool, f);
+				return;
+			}
+		}
+		if ( f.expanded ) {
+			expand(pool, f);
+			return;
+		}
+		split_file(f, opt.chunk_bytes);
+		f.remaining = f.chunks.size();
+		if ( f.chunks.empty() ) {
+			write(f);
+			return;
+		}
+		for ( size_t k = 1; k < f.chunks.size(); ++k ) {
+			lex_chunk* c = f.chunks[k].get();
+			pool.submit([this, &pool, &f, c]() { run_chunk(pool, f, *c); });
+		}
+		run_chunk(pool, f, *f.chunks[0]);
+	}
+
+	// 整个文件作为一段，和顺序分析一样先预处理；错误信息都由预处理器写出，恢复模式下也是
+	void expand(thread_pool& pool, lex_file& f) {
+		unique_ptr<lex_chunk> c(new lex_chunk);
+		c->begin = 0, c->end = f.buf.end() - f.buf.begin();
+		c->first_row = 0;
+		lex_result& r = c->result[0];
+		r.tx.reset(new texer);
+		r.tx->use_keywords(opt.keywords);
+		if ( opt.max_errors ) r.tx->recover(opt.max_errors);
+		r.tx->error_stream(r.errors);
+		for ( const string& dir : opt.include_dirs ) r.tx->add_include_dir(dir);
+		if ( !r.tx->init(f.path) ) {
+			++failed_files;
+			lock_guard<mutex> lock(out_m);
+			cout << "Cannot open " << f.path << cr;
+			return;
+		}
+		r.tx->preprocess();
+		for ( const token& tk : *r.tx ) r.tokens.emplace_back(tk);
+		r.end_comment = false;
+		r.failed = !r.tx->ok();
+		r.done = true;
+		f.chunks.emplace_back(move(c));
+		f.remaining = 1;
+		stitch(pool, f);
+	}
+
+	void run_chunk(thread_pool& pool, lex_file& f, lex_chunk& c) {
+		speculate(f, c, opt);
+		if ( --f.remaining == 0 ) stitch(pool, f);
+	}
+
+public:
+	explicit batch_lexer(const batch_options& _opt) : opt(_opt), total_tokens(0), total_bytes(0), failed_files(0) {}
+
+	// 输入是目录时分析其中所有普通文件，否则把它当作每行一个路径的文件列表
+	bool add_input(const string& input) {
+		error_code ec;
+		if ( filesystem::is_directory(input, ec) ) {
+			for ( auto& e : filesystem::recursive_directory_iterator(input, ec) ) {
+				if ( !e.is_regular_file() ) continue;
+				filesystem::path rel = filesystem::relative(e.path(), input);
+				add_file(e.path().string(), (filesystem::path(opt.out_dir) / rel).string() + extension());
+			}
+			return !ec;
+		}
+		ifstream ifs = ifstream(input, ios::in);
+		if ( !ifs ) return false;
+		string path;
+		while ( getline(ifs, path) ) {
+			if ( path.empty() ) continue;
+			// 去掉根目录和 ..，保持其余的目录结构
+			filesystem::path rel;
+			for ( auto& part : filesystem::path(path).relative_path() )
+				if ( part != ".." && part != "." ) rel /= part;
+			add_file(path, (filesystem::path(opt.out_dir) / rel).string() + extension());
+		}
+		return true;
+	}
+
+	const char* extension() const { return opt.binary ? ".bin" : ".tokens"; }
+
+	void add_file(const string& path, const string& out_path, bool label = true) {
+		unique_ptr<lex_file> f(new lex_file);
+		f->path = path;
+		f->out_path = out_path;
+		f->label = label;
+		files.emplace_back(move(f));
+	}
+
+	// quiet 时不打印统计
+	int run(bool quiet = false) {
+		auto t0 = chrono::steady_clock::now();
+		vector<thread_pool::worker_stats> stats;
+		size_t threads;
+		{
+			thread_pool pool(opt.threads);
+			threads = pool.size();
+			for ( auto& f : files ) {
+				lex_file* p = f.get();
+				pool.submit([this, &pool, p]() { start(pool, *p); });
+			}
+			pool.wait();
+			stats = pool.stats();
+		}
+		double wall = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		if ( quiet ) return failed_files > 0;
+
+		cout << "files: " << files.size() << ", failed: " << failed_files << cr;
+		cout << "tokens: " << total_tokens << ", bytes: " << total_bytes << cr;
+		cout << "time: " << wall << " s, " << total_tokens / wall << " tokens/s, "
+			 << total_bytes / wall / (1 << 20) << " MB/s" << cr;
+		for ( size_t i = 0; i < threads; ++i )
+			cout << "thread " << i << ": " << 100 * stats[i].busy / wall << "% busy, "
+				 << stats[i].tasks << " tasks, " << stats[i].stolen << " stolen" << cr;
+		if ( opt.cache ) opt.cache->write_stats(cout);
+		return failed_files > 0;
+	}
+};
+
+#endif
@@ -0,0 +1,166 @@
+// 增量词法分析的基准：模拟在文件中随机位置逐字输入和删除，与每次从头分析比较
+// 用法: bench_edit [源文件] [--repeat N] [--edits N] [--verify N]
+//   --repeat  把源文件重复 N 遍作为被编辑的文本，默认 2000
+//   --edits   修改次数，默认 20000，最后把全部 token 和从头分析的结果逐个核对
+//   --verify  另外在源文件上做 N 次随机的插入和删除，包括注释、引号、续行和非法字符，
+//             每次修改之后都把全部 token（行、列、类型、值）和从头分析的结果核对
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <random>
+#include "incremental.h"
+using namespace std;
+
+typedef chrono::steady_clock timer;
+
+double micros(timer::time_point a, timer::time_point b) {
+	return chrono::duration<double, micro>(b - a).count();
+}
+
+// 从头分析整个文本，全部 token 写成文本格式放到 out 中，返回是否没有出错
+bool full_lex(const string& text, symbol_table& symbols, string& out) {
+	texer tx;
+	ostringstream err;
+	tx.use_symbols(&symbols);
+	tx.error_stream(err);
+	tx.init(text.data(), text.size(), 0, false, false);
+	token tk;
+	out.clear();
+	while ( tx.next_token(tk) ) tk.append_to(out);
+	return tx.ok();
+}
+
+// 增量分析器当前的全部 token，格式和 full_lex 相同
+string tokens_of(const incremental_lexer& inc) {
+	ostringstream os;
+	inc.write(os);
+	return os.str();
+}
+
+// 在 text 上做 n 次随机修改，每次都和从头分析比较，返回第一次不一致的修改序号，全部一致时返回 n
+// 改出词法错误时多半马上撤销，错误留下来超过 20 次修改就重新载入原文，
+// 否则文本很快就一直停在第一个错误处，后面的部分测不到
+size_t verify(const string& text, size_t n, symbol_table& symbols) {
+	static const char* const pieces[] = {"a", "x1", "9", " ", "\n", "/*", "*/", "//", "\"", "'", "\\\n", "\\", "@",
+		"=", "+=", "<", ";", "(", "int ", "l1:"};
+	ostringstream err;
+	incremental_lexer inc(symbols);
+	inc.error_stream(err);
+	inc.load(text);
+	string mirror = text, expect;
+	// 偏移换算成行列号
+	auto position = [&](size_t off, size_t& row, size_t& col) {
+		size_t nl = off ? mirror.rfind(cr, off - 1) : string::npos;
+		row = count(mirror.begin(), mirror.begin() + off, cr);
+		col = nl == string::npos ? off : off - nl - 1;
+	};
+	// 把 [a, b) 换成 piece，两边都改，返回从头分析是否没有出错，结果不一致时 same 为假
+	bool same = true;
+	auto apply = [&](size_t a, size_t b, const string& piece) {
+		size_t r0, c0, r1, c1;
+		position(a, r0, c0);
+		position(b, r1, c1);
+		inc.edit(r0, c0, r1, c1, piece);
+		mirror.replace(a, b - a, piece);
+		bool ok = full_lex(mirror, symbols, expect);
+		same = inc.source() == mirror && ok == inc.ok() && tokens_of(inc) == expect;
+		return ok;
+	};
+	mt19937 rng(54321);
+	size_t failing = 0;		// 连续出错的修改次数
+	for ( size_t e = 0; e < n; ++e ) {
+		size_t a = rng() % (mirror.size() + 1), b = min(mirror.size(), a + (rng() % 3 ? 0 : rng() % 8));
+		string piece = rng() % 4 ? pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))] : "";
+		string removed = mirror.substr(a, b - a);
+		bool ok = apply(a, b, piece);
+		if ( !ok && same && rng() % 8 ) ok = apply(a, a + piece.size(), removed);
+		if ( !same ) return e;
+		failing = ok ? 0 : failing + 1;
+		if ( failing > 20 ) {
+			inc.load(text);
+			mirror = text;
+			failing = 0;
+		}
+	}
+	return n;
+}
+
+int main(int argc, char* argv [ ]) {
+	string path = "source.c";
+	size_t repeat = 2000, edits = 20000, checks = 0;
+	for ( int i = 1; i < argc; ++i ) {
+		string arg = argv[i];
+		if ( arg == "--repeat" && i + 1 < argc ) repeat = stoul(argv[++i]);
+		else if ( arg == "--edits" && i + 1 < argc ) edits = stoul(argv[++i]);
+		else if ( arg == "--verify" && i + 1 < argc ) checks = stoul(argv[++i]);
+		else path = arg;
+	}
+	ifstream ifs(path, ios::in | ios::binary);
+	if ( !ifs ) {
+		cout << "Cannot open " << path << cr;
+		return 1;
+	}
+	stringstream ss;
+	ss << ifs.rdbuf();
+	string one = ss.str(), text;
+	if ( !one.empty() && one.back() != cr ) one += cr;
+	for ( size_t i = 0; i < repeat; ++i ) text += one;
+
+	symbol_table symbols;
+	if ( checks ) {
+		size_t e = verify(one, checks, symbols);
+		if ( e < checks ) {
+			cout << "MISMATCH after random edit " << e << cr;
+			return 1;
+		}
+		cout << "verify: " << checks << " random edits match a full lex" << cr;
+	}
+
+	incremental_lexer inc(symbols);
+	auto t0 = timer::now();
+	inc.load(text);
+	auto t1 = timer::now();
+	cout << text.size() << " bytes, " << inc.lines() << " lines, " << inc.size() << " tokens" << cr;
+	cout << "full lex: " << micros(t0, t1) << " us" << cr;
+
+	// 在一个标识符的开头输入一个字母，下一次再删掉它，文本始终保持可以分析
+	// local 每次换到附近的标识符，像在一处连续编辑；scattered 每次跳到文件中随机的位置，
+	// 间隙要跟着移动很远，耗时主要是移动间隙
+	mt19937 rng(12345);
+	const char typed[] = "abcxyz";
+	for ( int scattered = 0; scattered < 2; ++scattered ) {
+		size_t relexed = 0, row = 0, col = 0, at = rng() % inc.size();
+		double total = 0;
+		for ( size_t e = 0; e < edits; ++e ) {
+			auto a = timer::now();
+			if ( e % 2 == 0 ) {
+				token tk;
+				do {
+					at = scattered ? rng() % inc.size() : min(inc.size() - 1, at + rng() % 64 - min<size_t>(at, 31));
+					tk = inc[at];
+				} while ( tk.type != identifier );
+				row = tk.row, col = tk.col;
+				inc.edit(row, col, row, col, string_view(typed + rng() % (sizeof(typed) - 1), 1));
+			}
+			else inc.edit(row, col, row, col + 1, "");
+			total += micros(a, timer::now());
+			relexed += inc.last.relexed_bytes;
+		}
+		cout << (scattered ? "scattered: " : "local:     ") << total / edits << " us/edit, "
+			 << double(relexed) / edits << " bytes relexed/edit" << cr;
+	}
+
+	// 最后的结果和从头分析一致，逐个比较 token 的行、列、类型和值
+	string final_text = inc.source(), expect;
+	t0 = timer::now();
+	bool ok = full_lex(final_text, symbols, expect);
+	t1 = timer::now();
+	cout << "full relex: " << micros(t0, t1) << " us" << cr;
+	if ( final_text != text || ok != inc.ok() || tokens_of(inc) != expect ) {
+		cout << "MISMATCH with a full lex of the edited text" << cr;
+		return 1;
+	}
+	return 0;
+}
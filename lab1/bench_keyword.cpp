@@ -0,0 +1,63 @@
+// 关键字查找的微基准：std::set<string> 与最小完美哈希
+// 用法: bench_keyword [查找次数]
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <random>
+#include "scanner.h"
+#include "keyword_hash.h"
+using namespace std;
+
+const char cr = 10;
+
+constexpr auto builtin_keywords = make_keyword_table<default_spec.keyword_count>(default_spec.keywords);
+
+// 生成测试单词：大部分是普通标识符，少数是关键字，与真实源码的比例接近
+vector<string> make_words(size_t count) {
+	const char* idents[] = {"i", "j", "sum", "a", "b", "printf", "count", "index", "l1", "tmp", "value", "x1"};
+	mt19937 rng(12345);
+	vector<string> words;
+	words.reserve(count);
+	for ( size_t i = 0; i < count; ++i ) {
+		if ( rng() % 5 == 0 )
+			words.emplace_back(default_spec.keywords[rng() % default_spec.keyword_count]);
+		else
+			words.emplace_back(idents[rng() % (sizeof(idents) / sizeof(idents[0]))]);
+	}
+	return words;
+}
+
+template<class F>
+double run(const char* name, const vector<string_view>& words, F&& is_keyword) {
+	size_t hits = 0;
+	auto t0 = chrono::steady_clock::now();
+	for ( string_view w : words ) hits += is_keyword(w);
+	auto t1 = chrono::steady_clock::now();
+	double ns = chrono::duration<double, nano>(t1 - t0).count() / words.size();
+	cout << name << ": " << ns << " ns/lookup, " << hits << " hits" << cr;
+	return ns;
+}
+
+int main(int argc, char* argv [ ]) {
+	size_t count = argc > 1 ? stoul(argv[1]) : 10000000;
+	vector<string> storage = make_words(count);
+	vector<string_view> words(storage.begin(), storage.end());
+
+	set<string, less<>> tree;
+	for ( int i = 0; i < default_spec.keyword_count; ++i )
+		tree.emplace(default_spec.keywords[i]);
+	keyword_view builtin = builtin_keywords.view();
+
+	keyword_table runtime;
+	runtime.build(vector<string>(default_spec.keywords, default_spec.keywords + default_spec.keyword_count));
+	keyword_view user = runtime.view();
+
+	double base = run("std::set      ", words, [&](string_view w) { return tree.find(w) != tree.end(); });
+	double fast = run("phf (constexpr)", words, [&](string_view w) { return builtin.contains(w); });
+	run("phf (runtime)  ", words, [&](string_view w) { return user.contains(w); });
+	cout << "speedup: " << base / fast << "x" << cr;
+	return 0;
+}
@@ -0,0 +1,178 @@
+#ifndef HOTPATH_H
+#define HOTPATH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HOTPATH_TSC 1
+#endif
+#include "token.h"
+
+// 热路径计数：词法分析和语法分析各阶段的进入次数和耗时，token 类型、长度和分析栈深度的直方图
+// 只在定义了 HOTPATH_STATS 时编译进去（-DHOTPATH_STATS），否则 HOT_* 宏都展开成空，热路径上没有任何代码。
+// 计时读 TSC，不是 x86 时退回 steady_clock 的纳秒；输出时按进程运行期间的墙钟时间换算成秒。
+// 每个线程计到自己的 thread_local 计数里，热路径上没有原子操作和锁，线程退出时再并入总数。
+
+enum hot_phase : uint8_t {
+	hp_skip,		// texer::skip
+	hp_next_word,	// texer::next_word
+	hp_classify,	// 关键字、标签的判断和登记符号
+	hp_format,		// 把 token 写成文本
+	hp_shift,		// 算符优先分析的移进
+	hp_handle,		// 找句柄并匹配产生式
+	hp_reduce,		// 建语法树结点并规约
+	hp_trace,		// 分析过程的输出
+	hp_lalr,		// 整个程序的 LALR(1) 分析
+	hot_phases
+};
+
+inline const char* const hot_phase_name[] = {
+	"skip", "next_word", "classify", "format", "shift", "handle", "reduce", "trace", "lalr"
+};
+
+inline uint64_t hot_ticks() {
+#ifdef HOTPATH_TSC
+	return __rdtsc();
+#else
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct hot_counters {
+	static const int type_count = invalid + 1;
+	static const int max_length = 64;		// 更长的 token 计在最后一格
+	static const int depth_buckets = 33;	// 第 k 格是深度在 [2^(k-1), 2^k) 之间，第 0 格是 0
+
+	uint64_t calls[hot_phases];
+	uint64_t ticks[hot_phases];
+	uint64_t types[type_count];
+	uint64_t lengths[max_length + 1];
+	uint64_t depths[depth_buckets];
+
+	void token(int type, size_t length) {
+		++types[type];
+		++lengths[min<size_t>(length, max_length)];
+	}
+
+	void depth(size_t d) {
+		int k = 0;
+		for ( ; d && k + 1 < depth_buckets; d >>= 1 ) ++k;
+		++depths[k];
+	}
+
+	void add(const hot_counters& o) {
+		for ( int i = 0; i < hot_phases; ++i ) calls[i] += o.calls[i], ticks[i] += o.ticks[i];
+		for ( int i = 0; i < type_count; ++i ) types[i] += o.types[i];
+		for ( int i = 0; i <= max_length; ++i ) lengths[i] += o.lengths[i];
+		for ( int i = 0; i < depth_buckets; ++i ) depths[i] += o.depths[i];
+	}
+};
+
+// 所有线程的计数：活着的线程登记在 live 中，退出的并入 retired
+class hot_registry {
+	mutex lock;
+	hot_counters retired;
+	vector<const hot_counters*> live;
+	uint64_t start_ticks;
+	chrono::steady_clock::time_point start_time;
+
+public:
+	hot_registry() : retired{}, start_ticks(hot_ticks()), start_time(chrono::steady_clock::now()) {}
+
+	void enter(const hot_counters* c) {
+		lock_guard<mutex> g(lock);
+		live.emplace_back(c);
+	}
+
+	void leave(const hot_counters* c) {
+		lock_guard<mutex> g(lock);
+		retired.add(*c);
+		live.erase(find(live.begin(), live.end(), c));
+	}
+
+	hot_counters total() {
+		lock_guard<mutex> g(lock);
+		hot_counters res = retired;
+		for ( const hot_counters* c : live ) res.add(*c);
+		return res;
+	}
+
+	// 每秒的计时单位数，由进程开始以来的 TSC 和墙钟时间得到
+	double ticks_per_second() const {
+		double s = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+		return s > 0 ? (hot_ticks() - start_ticks) / s : 1e9;
+	}
+};
+
+inline hot_registry hot_all;
+
+// 本线程的计数，第一次使用时登记
+struct hot_local : hot_counters {
+	hot_local() : hot_counters{} { hot_all.enter(this); }
+	~hot_local() { hot_all.leave(this); }
+};
+
+inline thread_local hot_local hot;
+
+// 作用域计时，离开作用域时计入一个阶段
+class hot_scope {
+	hot_phase phase;
+	uint64_t start;
+public:
+	explicit hot_scope(hot_phase p) : phase(p), start(hot_ticks()) {}
+	~hot_scope() {
+		hot.ticks[phase] += hot_ticks() - start;
+		++hot.calls[phase];
+	}
+};
+
+#define HOT_CONCAT2(a, b) a##b
+#define HOT_CONCAT(a, b) HOT_CONCAT2(a, b)
+#ifdef HOTPATH_STATS
+const bool hot_enabled = true;
+#define HOT_SCOPE(p) hot_scope HOT_CONCAT(hot_scope_, __LINE__)(p)
+#define HOT_TOKEN(type, length) hot.token(type, length)
+#define HOT_DEPTH(d) hot.depth(d)
+#else
+const bool hot_enabled = false;
+#define HOT_SCOPE(p) ((void)0)
+#define HOT_TOKEN(type, length) ((void)0)
+#define HOT_DEPTH(d) ((void)0)
+#endif
+
+// 写成一个 JSON 对象，没有编译进计数时 enabled 为 false，其余都是 0
+inline void write_hot_stats(ostream& os) {
+	hot_counters c = hot_all.total();
+	double hz = hot_all.ticks_per_second();
+	auto list = [&](const uint64_t* v, int n) {
+		os << '[';
+		for ( int i = 0; i < n; ++i ) os << (i ? ", " : "") << v[i];
+		os << ']';
+	};
+	os << "{\"enabled\": " << (hot_enabled ? "true" : "false");
+#ifdef HOTPATH_TSC
+	os << ", \"clock\": \"tsc\"";
+#else
+	os << ", \"clock\": \"ns\"";
+#endif
+	os << ", \"ticks_per_second\": " << uint64_t(hz) << ", \"phases\": {";
+	for ( int i = 0; i < hot_phases; ++i ) {
+		os << (i ? ", " : "") << '"' << hot_phase_name[i] << "\": {\"calls\": " << c.calls[i]
+		   << ", \"ticks\": " << c.ticks[i] << ", \"seconds\": " << c.ticks[i] / hz << '}';
+	}
+	os << "}, \"token_types\": {";
+	for ( int i = 0; i < hot_counters::type_count; ++i )
+		os << (i ? ", " : "") << '"' << token_type_name[i] << "\": " << c.types[i];
+	os << "}, \"token_length\": ";
+	list(c.lengths, hot_counters::max_length + 1);
+	os << ", \"stack_depth_log2\": ";
+	list(c.depths, hot_counters::depth_buckets);
+	os << "}\n";
+}
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "texer.h"
+
+// 增量词法分析：文本被小段修改时只重新分析修改附近的 token
+// 词法分析器在 token 之间的状态只有位置，从任何一个 token 的结尾重新开始，结果与从头分析相同。
+// 一次修改从第一个可能受影响的 token 之前的那个 token 结尾开始重新分析，
+// 新 token 的起点与修改之后的某个旧 token 的起点重合时，后面的结果必然相同，就此停下。
+//
+// 文本、行首和 token 都放在间隙缓冲里，间隙停在最近修改的位置，改动只移动附近的元素。
+// 间隙后面的行首和 token 记的是到文本结尾的距离、到最后一行的距离，
+// 修改之后不用逐个平移，只在跨过间隙时换算；列号只有修改所在那一行的 token 需要重算。
+
+// 间隙缓冲：元素分成前后两段放在同一个数组里，在间隙处插入删除只动被改的元素，
+// 移动间隙的代价和移动的距离成正比
+template<class T>
+class gap_buffer {
+	std::vector<T> items;
+	size_t gap, gap_len;
+
+	void reserve(size_t need) {
+		if ( gap_len >= need ) return;
+		size_t tail = items.size() - gap - gap_len;
+		size_t len = std::max(items.size() * 2, size() + need + 64);
+		std::vector<T> next(len);
+		std::move(items.begin(), items.begin() + gap, next.begin());
+		std::move(items.end() - tail, items.end(), next.end() - tail);
+		items.swap(next);
+		gap_len = len - gap - tail;
+	}
+
+public:
+	gap_buffer() : gap(0), gap_len(0) {}
+
+	size_t size() const { return items.size() - gap_len; }
+	size_t gap_at() const { return gap; }
+	T& operator [] (size_t i) { return items[i < gap ? i : i + gap_len]; }
+	const T& operator [] (size_t i) const { return items[i < gap ? i : i + gap_len]; }
+
+	void clear() {
+		items.clear();
+		gap = gap_len = 0;
+	}
+
+	// 把间隙移到 pos，跨过间隙的元素依次交给 cross(元素, 是否移到了间隙前面)
+	template<class F>
+	void move_gap(size_t pos, F&& cross) {
+		for ( ; gap > pos; ) {
+			--gap;
+			T& x = items[gap + gap_len] = items[gap];
+			cross(x, false);
+		}
+		for ( ; gap < pos; ++gap ) {
+			T& x = items[gap] = items[gap + gap_len];
+			cross(x, true);
+		}
+	}
+
+	void move_gap(size_t pos) {
+		if ( pos < gap ) std::move_backward(items.begin() + pos, items.begin() + gap, items.begin() + gap + gap_len);
+		else std::move(items.begin() + gap + gap_len, items.begin() + pos + gap_len, items.begin() + gap);
+		gap = pos;
+	}
+
+	// 删掉间隙后面的 count 个元素
+	void erase_after(size_t count) { gap_len += count; }
+
+	// 在间隙前面加入元素
+	void push(const T& x) {
+		reserve(1);
+		items[gap++] = x;
+		--gap_len;
+	}
+
+	template<class It>
+	void insert(It first, It last) {
+		reserve(last - first);
+		for ( ; first != last; ++first, --gap_len ) items[gap++] = *first;
+	}
+
+	// [a, b) 连续存放时的起点，间隙在中间时先把它移到 b
+	const T* span(size_t a, size_t b) {
+		if ( a < gap && gap < b ) move_gap(b);
+		return items.data() + (a < gap ? a : a + gap_len);
+	}
+};
+
+class incremental_lexer {
+	typedef size_t size_type;
+
+	// 间隙前的 token 记偏移和行号，间隙后的记到文本结尾、到最后一行的距离
+	struct entry {
+		uint32_t off, end;		// 起点，和分析它时读到的位置（续行拼接的单词结束在下一行）
+		uint32_t row, col;
+		uint32_t sym;
+		uint8_t type;
+	};
+
+	gap_buffer<char> text;
+	gap_buffer<uint32_t> line_start;	// 间隙前是偏移，间隙后是到文本结尾的距离
+	gap_buffer<entry> tokens;
+	symbol_table* symbols;
+	keyword_view keywords;
+	ostream* err;
+	bool failed;
+
+	size_type line_offset(size_type r) const {
+		if ( r >= line_start.size() ) return text.size();
+		return r < line_start.gap_at() ? line_start[r] : text.size() - line_start[r];
+	}
+
+	size_type row_of(size_type off) const {
+		size_type lo = 0, hi = line_start.size();
+		while ( hi - lo > 1 ) {
+			size_type mid = (lo + hi) / 2;
+			if ( line_offset(mid) <= off ) lo = mid;
+			else hi = mid;
+		}
+		return lo;
+	}
+
+	// 行列号换成偏移，越过行尾或文本结尾时取行尾或文本结尾
+	size_type offset_of(size_type r, size_type c) const {
+		if ( r >= line_start.size() ) return text.size();
+		size_type b = line_offset(r);
+		size_type e = r + 1 < line_start.size() ? line_offset(r + 1) - 1 : text.size();
+		return b + min(c, e - b);
+	}
+
+	// 第 i 个 token 的绝对位置
+	entry at(size_type i) const {
+		entry e = tokens[i];
+		if ( i >= tokens.gap_at() ) to_absolute(e);
+		return e;
+	}
+
+	void to_absolute(entry& e) const {
+		e.off = text.size() - e.off;
+		e.end = text.size() - e.end;
+		e.row = line_start.size() - e.row;
+	}
+
+	void to_relative(entry& e) const { to_absolute(e); }		// 两种换算互逆，都是用总数去减
+
+	void relex(size_type s, size_type edit_end);
+
+public:
+	struct statistics {
+		size_t relexed_bytes;	// 重新分析的字节数
+		size_t new_tokens;		// 重新生成的 token 个数
+		size_t removed_tokens;	// 丢掉的旧 token 个数
+	};
+	statistics last;			// 最近一次修改
+
+	explicit incremental_lexer(symbol_table& _symbols) : symbols(&_symbols), keywords(builtin_keywords.view()),
+		err(&cout), failed(false), last{0, 0, 0} {}
+
+	void use_keywords(keyword_view kw) { keywords = kw; }
+	void error_stream(ostream& os) { err = &os; }
+
+	// 换掉整个文本并从头分析
+	void load(string_view src) {
+		text.clear(), line_start.clear(), tokens.clear();
+		line_start.push(0);
+		failed = false;
+		edit(0, 0, 0, 0, src);
+	}
+
+	// 把 (r0, c0) 到 (r1, c1) 之间的文本换成 src，行列号从 0 开始，只重新分析受影响的 token
+	void edit(size_type r0, size_type c0, size_type r1, size_type c1, string_view src);
+
+	size_type size() const { return tokens.size(); }
+	size_type lines() const { return line_start.size(); }
+	bool ok() const { return !failed; }		// 分析到文本结尾都没有出错
+
+	token operator [] (size_type i) const {
+		entry e = at(i);
+		return token(e.row, e.col, token_type(e.type), symbols->name(e.sym), e.sym);
+	}
+
+	string source() const {
+		string s;
+		for ( size_type i = 0; i < text.size(); ++i ) s += text[i];
+		return s;
+	}
+
+	// 写成和 texer 相同的文本格式
+	void write(ostream& os) const {
+		string out;
+		for ( size_type i = 0; i < size(); ++i ) (*this)[i].append_to(out);
+		os.write(out.data(), out.size());
+	}
+};
+
+inline void incremental_lexer::edit(size_type r0, size_type c0, size_type r1, size_type c1, string_view src) {
+	size_type a = offset_of(r0, c0), b = max(a, offset_of(r1, c1));
+	last = {0, 0, 0};
+
+	// 读到 a 或更远的 token 都可能变，从它前一个 token 的结尾开始重新分析
+	size_type lo = 0, hi = tokens.size();
+	while ( lo < hi ) {
+		size_type mid = (lo + hi) / 2;
+		if ( at(mid).end < a ) lo = mid + 1;
+		else hi = mid;
+	}
+	size_type k = lo;
+	size_type s = k > 0 ? at(k - 1).end : 0;
+	tokens.move_gap(k, [this](entry& e, bool front) { front ? to_absolute(e) : to_relative(e); });
+
+	// 改文本和行首，a 所在行之后的行首都在间隙后面，平移由到结尾的距离自然得到
+	size_type ra = row_of(a), rb = row_of(b);
+	line_start.move_gap(ra + 1, [this](uint32_t& v, bool) { v = text.size() - v; });
+	line_start.erase_after(rb - ra);
+	text.move_gap(a);
+	text.erase_after(b - a);
+	text.insert(src.begin(), src.end());
+	for ( size_type i = 0; i < src.size(); ++i )
+		if ( src[i] == cr ) line_start.push(a + i + 1);
+
+	relex(s, a + src.size());
+}
+
+inline void incremental_lexer::relex(size_type s, size_type edit_end) {
+	texer tx;
+	tx.use_keywords(keywords);
+	tx.use_symbols(symbols);
+	tx.error_stream(*err);
+	bool comment = false;
+	size_type from = s, window = 0;
+	token tk;
+	for ( ; ; ) {
+		// 下一段：至少到修改之后的第二行，以后每段加倍，在可以切分的行首结束
+		size_type r = row_of(from);
+		size_type want = max({edit_end, from + window * 2, from + 1});
+		size_type hi = line_offset(row_of(min(want, text.size())) + 2), cut = 0;
+		for ( ; ; ) {
+			if ( hi == text.size() ) {
+				cut = hi - from;
+				break;
+			}
+			if ( (cut = split_point(text.span(from, hi), 0, hi - from)) > 0 ) break;
+			hi = line_offset(row_of(hi) + 2);
+		}
+		window = cut;
+		bool more = from + cut < text.size();
+		tx.init(text.span(from, from + cut), cut, r, comment, more, from - line_offset(r));
+		last.relexed_bytes += cut;
+
+		while ( tx.next_token(tk) ) {
+			size_type off = line_offset(tk.row) + tk.col;
+			// 丢掉新 token 之前的旧 token，起点重合且在修改之后时已经同步
+			while ( tokens.gap_at() < tokens.size() ) {
+				entry old = at(tokens.gap_at());
+				if ( old.off > off ) break;
+				if ( old.off == off && off >= edit_end ) {
+					// 修改所在行上剩下的 token 列号要重算
+					size_type row = old.row;
+					for ( size_type i = tokens.gap_at(); i < tokens.size(); ++i ) {
+						entry e = at(i);
+						if ( e.row != row ) break;
+						tokens[i].col = e.off - line_offset(row);
+					}
+					return;
+				}
+				tokens.erase_after(1);
+				++last.removed_tokens;
+			}
+			size_type end = line_offset(tx.next_row()) + tx.next_col();
+			tokens.push({uint32_t(off), uint32_t(end), uint32_t(tk.row), uint32_t(tk.col), tk.sym, uint8_t(tk.type)});
+			++last.new_tokens;
+		}
+		if ( !tx.ok() || !more ) break;
+		comment = tx.comment_open();
+		from += cut;
+	}
+	// 分析到了结尾或出错，剩下的旧 token 都不再有效
+	failed = !tx.ok();
+	last.removed_tokens += tokens.size() - tokens.gap_at();
+	tokens.erase_after(tokens.size() - tokens.gap_at());
+}
+
+#endif
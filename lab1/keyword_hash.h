@@ -0,0 +1,175 @@
+#ifndef KEYWORD_HASH_H
+#define KEYWORD_HASH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+// 关键字的最小完美哈希（hash and displace）
+// 每个关键字先按哈希值分到桶里，再给每个桶找一个位移 d，
+// 使桶内关键字落到互不冲突的空槽上。n 个关键字恰好占 n 个槽。
+// 查找时只算一次哈希，再做一次带长度检查的比较，不分配内存。
+
+constexpr uint64_t phf_hash(std::string_view s, uint64_t seed) {
+	uint64_t h = 0xcbf29ce484222325ull ^ seed;
+	for ( char ch : s ) {
+		h ^= (uint8_t)ch;
+		h *= 0x100000001b3ull;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+// 由桶的位移和哈希高位得到槽号
+constexpr uint32_t phf_slot(uint64_t h, uint32_t d, uint32_t n) {
+	uint32_t x = uint32_t(h >> 32) ^ (d * 0x9e3779b9u);
+	x *= 0x85ebca6bu;
+	x ^= x >> 13;
+	return x % n;
+}
+
+// 构造过程，编译期和运行期共用
+// slot_key 长度为 n，scratch 长度至少为 2 * nb + n + 1
+constexpr bool phf_build(const std::string_view* keys, uint32_t n, uint32_t nb, uint64_t seed,
+						 uint32_t* disp, int32_t* slot_key, uint32_t* scratch) {
+	const uint32_t max_bucket = 16;
+	uint32_t* start = scratch;				// 各桶在 by_bucket 中的起点，nb + 1 项
+	uint32_t* order = scratch + nb + 1;		// 按桶大小从大到小的处理顺序
+	uint32_t* by_bucket = order + nb;		// 按桶排好的关键字下标
+
+	for ( uint32_t b = 0; b <= nb; ++b ) start[b] = 0;
+	for ( uint32_t i = 0; i < n; ++i ) by_bucket[i] = n;
+	for ( uint32_t i = 0; i < n; ++i ) ++start[phf_hash(keys[i], seed) % nb + 1];
+	uint32_t largest = 0;
+	for ( uint32_t b = 0; b < nb; ++b ) {
+		largest = std::max(largest, start[b + 1]);
+		start[b + 1] += start[b];
+	}
+	if ( largest > max_bucket ) return false;
+	for ( uint32_t i = 0; i < n; ++i ) {
+		uint32_t b = phf_hash(keys[i], seed) % nb;
+		uint32_t k = start[b];
+		while ( k < start[b + 1] && by_bucket[k] != n ) ++k;
+		by_bucket[k] = i;
+	}
+	uint32_t m = 0;
+	for ( uint32_t size = largest; size > 0; --size )
+		for ( uint32_t b = 0; b < nb; ++b )
+			if ( start[b + 1] - start[b] == size ) order[m++] = b;
+
+	for ( uint32_t i = 0; i < n; ++i ) slot_key[i] = -1;
+	for ( uint32_t b = 0; b < nb; ++b ) disp[b] = 0;
+
+	for ( uint32_t k = 0; k < m; ++k ) {
+		uint32_t b = order[k];
+		uint32_t slots[max_bucket] = {};
+		bool placed = false;
+		for ( uint32_t d = 0; d < 64 * n + 64 && !placed; ++d ) {
+			placed = true;
+			for ( uint32_t j = start[b]; j < start[b + 1] && placed; ++j ) {
+				uint32_t s = phf_slot(phf_hash(keys[by_bucket[j]], seed), d, n);
+				if ( slot_key[s] >= 0 ) placed = false;
+				for ( uint32_t t = start[b]; t < j && placed; ++t )
+					if ( slots[t - start[b]] == s ) placed = false;
+				slots[j - start[b]] = s;
+			}
+			if ( placed ) {
+				disp[b] = d;
+				for ( uint32_t j = start[b]; j < start[b + 1]; ++j )
+					slot_key[slots[j - start[b]]] = by_bucket[j];
+			}
+		}
+		if ( !placed ) return false;
+	}
+	return true;
+}
+
+constexpr uint32_t phf_buckets(uint32_t n) { return n / 2 + 1; }
+
+// 查找用的只读视图，编译期表和运行期表都转换成它
+struct keyword_view {
+	uint64_t seed;
+	uint32_t n, nb;
+	const uint32_t* disp;
+	const std::string_view* slot;
+
+	// 返回关键字所在的槽，不是关键字返回 -1
+	constexpr int find(std::string_view s) const {
+		if ( n == 0 ) return -1;
+		uint64_t h = phf_hash(s, seed);
+		uint32_t i = phf_slot(h, disp[h % nb], n);
+		return slot[i] == s ? int(i) : -1;
+	}
+	constexpr bool contains(std::string_view s) const { return find(s) >= 0; }
+};
+
+// 编译期生成的关键字表
+template<uint32_t N>
+struct static_keyword_table {
+	static constexpr uint32_t NB = phf_buckets(N);
+
+	uint64_t seed;
+	uint32_t disp[NB];
+	std::string_view slot[N];
+
+	constexpr keyword_view view() const { return { seed, N, NB, disp, slot }; }
+};
+
+template<uint32_t N>
+constexpr static_keyword_table<N> make_keyword_table(const std::string_view* keys) {
+	static_keyword_table<N> t{};
+	int32_t slot_key[N] = {};
+	uint32_t scratch[2 * static_keyword_table<N>::NB + N + 1] = {};
+	for ( uint64_t seed = 0; ; ++seed ) {
+		if ( phf_build(keys, N, t.NB, seed, t.disp, slot_key, scratch) ) {
+			t.seed = seed;
+			break;
+		}
+	}
+	for ( uint32_t i = 0; i < N; ++i ) t.slot[i] = keys[slot_key[i]];
+	return t;
+}
+
+// 运行期生成的关键字表，用于用户给出的关键字集合
+class keyword_table {
+	uint64_t seed;
+	std::vector<std::string> words;
+	std::vector<uint32_t> disp;
+	std::vector<std::string_view> slot;
+
+public:
+	keyword_table() : seed(0) {}
+	keyword_table(const keyword_table&) = delete;
+	keyword_table& operator = (const keyword_table&) = delete;
+
+	void build(std::vector<std::string> keys) {
+		sort(keys.begin(), keys.end());
+		keys.erase(unique(keys.begin(), keys.end()), keys.end());
+		words = move(keys);
+
+		uint32_t n = words.size(), nb = phf_buckets(n);
+		std::vector<std::string_view> views(words.begin(), words.end());
+		std::vector<int32_t> slot_key(n);
+		std::vector<uint32_t> scratch(2 * nb + n + 1);
+		disp.assign(nb, 0);
+		for ( seed = 0; seed < 4096; ++seed ) {
+			if ( phf_build(views.data(), n, nb, seed, disp.data(), slot_key.data(), scratch.data()) )
+				break;
+		}
+		if ( n > 0 && seed == 4096 )
+			throw std::runtime_error("cannot build perfect hash for keyword set");
+		slot.resize(n);
+		for ( uint32_t i = 0; i < n; ++i ) slot[i] = views[slot_key[i]];
+	}
+
+	keyword_view view() const {
+		return { seed, uint32_t(slot.size()), uint32_t(disp.size()), disp.data(), slot.data() };
+	}
+};
+
+#endif
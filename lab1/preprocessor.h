@@ -0,0 +1,1056 @@
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#include <cctype>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <sys/stat.h>
+#include "texer.h"
+using namespace std;
+
+// 预处理器：#include、对象式和函数式宏、条件编译
+// 每个文件只做一遍词法分析：普通行成段交给 texer，指令逐条解析，得到 token 和指令的序列。
+// 头文件的分析结果按路径缓存，修改时间、大小和关键字表都没变时直接复用，
+// 条件选择和宏展开都在缓存的 token 上进行，不重新分析。
+// 文件以 #ifndef X / #define X 开头、配对的 #endif 在最后时记下保护宏 X，X 已定义时不再打开这个文件；
+// #pragma once 的文件只包含一次。宏展开用隐藏集防止递归，实参先完全展开再代入。
+// 主文件不整个预先分析，普通行边分析边展开边输出，不另外占用和文件大小成正比的内存。
+// 输出的位置都在主文件中：头文件中的 token 位于主文件的 #include 处，宏展开的结果位于宏调用处，
+// 所以输出仍按位置单调递增，可以直接放进 token 表。
+// 分析时总是用恢复模式，非法单词先留在 token 中，输出时才报告，所以跳过的条件分支中的非法单词不算错误。
+// 不支持 # 和 ## 运算符，词法分析器把 # 之后的内容当作注释。
+
+enum pp_kind : uint8_t {
+	pp_text,		// 一段普通行的 token
+	pp_include,
+	pp_define,
+	pp_undef,
+	pp_if,
+	pp_ifdef,
+	pp_ifndef,
+	pp_elif,
+	pp_else,
+	pp_endif,
+	pp_once,		// #pragma once
+	pp_error,		// #error，text 是信息
+	pp_ignored,		// 不影响输出的指令：空指令、其他 #pragma、#line、#warning
+	pp_invalid,		// 写错的指令，text 是错误信息
+};
+
+// 文件中的一项：一段普通行或一条指令
+struct pp_item {
+	pp_kind kind;
+	bool system = false;		// #include <...>
+	bool function = false;		// 函数式宏
+	size_t row = 0;				// 指令所在的行
+	size_t col = 0;				// 指令中 # 所在的列
+	size_t first = 0, last = 0;	// 普通行或宏体在 tokens 中的范围
+	string_view name;			// 宏名或文件名
+	string_view text;			// #if / #elif 的条件
+	vector<string_view> params;
+};
+
+// 分析过的一个文件，头文件分析完后不再修改，可以被多个预处理器共用；
+// 主文件的普通行边分析边输出，不放进 tokens，items 中只有指令
+struct pp_file {
+	string path;
+	timespec mtime = {};
+	off_t size = 0;
+	const string_view* keywords = nullptr;	// 分析时用的关键字表
+	bool whole = false;						// 非法单词延长到了下一个空白或界符之前
+	source_buffer buf;
+	const source_buffer* text = &buf;		// 文件内容，主文件指向 texer 的缓冲区
+	texer tx;					// 续行拼接出的单词归它所有
+	deque<string> lines;		// 带续行的指令拼成的逻辑行
+	vector<token> tokens;
+	vector<pp_item> items;
+	string_view guard;			// 保护宏，没有时为空
+};
+
+struct pp_options {
+	keyword_view keywords = builtin_keywords.view();
+	bool recover = false;			// 输出非法单词并继续，否则在第一个非法单词处停止
+	size_t max_errors = 1000;		// 恢复模式下最多报告的非法单词
+	vector<string> include_dirs;	// <...> 只在这些目录中查找，"..." 先找所在文件的目录
+	ostream* err = &cout;
+};
+
+// 分析过的头文件，按路径缓存，可以在多个线程间共用
+class pp_cache {
+	mutex lock;
+	unordered_map<string, shared_ptr<pp_file>> files;
+	size_t hits = 0, misses = 0;
+
+public:
+	// 文件状态、关键字表和非法单词的取法都没变时返回缓存的结果
+	shared_ptr<pp_file> find(const string& path, const struct stat& st, keyword_view kw, bool whole) {
+		lock_guard<mutex> g(lock);
+		auto it = files.find(path);
+		if ( it != files.end() ) {
+			const pp_file& f = *it->second;
+			if ( f.mtime.tv_sec == st.st_mtim.tv_sec && f.mtime.tv_nsec == st.st_mtim.tv_nsec && f.size == st.st_size
+				 && f.keywords == kw.slot && f.whole == whole ) {
+				++hits;
+				return it->second;
+			}
+		}
+		++misses;
+		return nullptr;
+	}
+
+	void insert(shared_ptr<pp_file> f) {
+		lock_guard<mutex> g(lock);
+		files[f->path] = move(f);
+	}
+
+	size_t hit_count() const { return hits; }
+	size_t miss_count() const { return misses; }
+};
+
+inline pp_cache include_cache;
+
+// 预处理时查看过的一个头文件路径，存在时 text 是分析时读到的内容，否则为空
+struct pp_dependency {
+	string path;
+	const source_buffer* text;
+};
+
+// 以空白开头、第一个非空白字符是 # 的行
+inline bool pp_directive_line(string_view line) {
+	size_t i = line.find_first_not_of(" \t");
+	return i != string_view::npos && line[i] == '#';
+}
+
+// 有预处理指令的文件要先预处理，没有的按原样分析
+inline bool pp_has_directives(const source_buffer& b) {
+	for ( size_t r = 0; r < b.lines(); ++r )
+		if ( pp_directive_line(b[r]) ) return true;
+	return false;
+}
+
+// 一条指令之后是否仍在块注释中
+inline bool pp_opens_comment(string_view s) {
+	for ( size_t i = 0; i < s.size(); ++i ) {
+		char c = s[i];
+		if ( c == '"' || c == '\'' ) {
+			for ( ++i; i < s.size() && s[i] != c; ++i )
+				if ( s[i] == '\\' ) ++i;
+		}
+		else if ( c == '/' && i + 1 < s.size() && s[i + 1] == '/' ) return false;
+		else if ( c == '/' && i + 1 < s.size() && s[i + 1] == '*' ) {
+			size_t e = s.find("*/", i + 2);
+			if ( e == string_view::npos ) return true;
+			i = e + 1;
+		}
+	}
+	return false;
+}
+
+// 把 #if 条件切成单词：标识符和数字、字符常量、一到两个字符的运算符，跳过注释
+inline void pp_words(string_view s, vector<string_view>& out) {
+	static const char* const pairs[] = {"&&", "||", "==", "!=", "<=", ">=", "<<", ">>"};
+	auto word_char = [](char c) { return isalnum((unsigned char)c) || c == '_'; };
+	for ( size_t i = 0; i < s.size(); ) {
+		char c = s[i];
+		if ( c == ' ' || c == '\t' || c == '\r' ) {
+			++i;
+			continue;
+		}
+		if ( s.compare(i, 2, "//") == 0 ) break;
+		if ( s.compare(i, 2, "/*") == 0 ) {
+			size_t e = s.find("*/", i + 2);
+			i = e == string_view::npos ? s.size() : e + 2;
+			continue;
+		}
+		size_t j = i + 1;
+		if ( word_char(c) ) {
+			while ( j < s.size() && word_char(s[j]) ) ++j;
+		}
+		else if ( c == '\'' ) {
+			while ( j < s.size() && s[j] != '\'' ) j += s[j] == '\\' ? 2 : 1;
+			j = min(j + 1, s.size());
+		}
+		else {
+			for ( const char* p : pairs )
+				if ( s.compare(i, 2, p) == 0 ) j = i + 2;
+		}
+		out.emplace_back(s.substr(i, j - i));
+		i = j;
+	}
+}
+
+// #if 条件求值，运算符和优先级与 C 相同，宏展开后剩下的标识符都是 0
+// 算术按 long long 的补码回绕，和 GCC 的结果相同，溢出时不报错
+class pp_expr {
+	vector<string_view> w;
+	size_t i = 0;
+	bool bad = false;
+
+	string_view peek() const { return i < w.size() ? w[i] : string_view(); }
+	bool eat(string_view op) {
+		if ( i < w.size() && w[i] == op ) {
+			++i;
+			return true;
+		}
+		return false;
+	}
+
+	long long number(string_view t) {
+		if ( t[0] == '\'' ) {
+			if ( t.size() < 3 ) {
+				bad = true;
+				return 0;
+			}
+			if ( t[1] != '\\' ) return (unsigned char)t[1];
+			switch ( t[2] ) {
+			case 'n': return '\n';
+			case 't': return '\t';
+			case 'r': return '\r';
+			case '0': return 0;
+			default: return (unsigned char)t[2];
+			}
+		}
+		if ( !isdigit((unsigned char)t[0]) ) return 0;
+		string s(t);
+		while ( !s.empty() && strchr("uUlL", s.back()) ) s.pop_back();
+		char* end;
+		long long v = strtoll(s.c_str(), &end, 0);
+		if ( *end ) bad = true;
+		return v;
+	}
+
+	long long unary() {
+		if ( eat("!") ) return !unary();
+		if ( eat("~") ) return ~unary();
+		if ( eat("-") ) return (long long)(0 - (unsigned long long)unary());
+		if ( eat("+") ) return unary();
+		string_view t = peek();
+		if ( t.empty() ) {
+			bad = true;
+			return 0;
+		}
+		++i;
+		if ( t == "(" ) {
+			long long v = cond();
+			if ( !eat(")") ) bad = true;
+			return v;
+		}
+		return number(t);
+	}
+
+	// 二元运算，level 越大优先级越高
+	long long binary(int level) {
+		static const string_view ops[][4] = {
+			{"||"}, {"&&"}, {"|"}, {"^"}, {"&"}, {"==", "!="}, {"<", ">", "<=", ">="}, {"<<", ">>"}, {"+", "-"}, {"*", "/", "%"}
+		};
+		const int levels = sizeof(ops) / sizeof(ops[0]);
+		if ( level == levels ) return unary();
+		long long v = binary(level + 1);
+		for ( ;; ) {
+			string_view op = peek();
+			if ( op.empty() || find(begin(ops[level]), end(ops[level]), op) == end(ops[level]) ) return v;
+			++i;
+			long long r = binary(level + 1);
+			if ( (op == "/" || op == "%") && r == 0 ) {
+				bad = true;
+				return 0;
+			}
+			if ( op == "||" ) v = v || r;
+			else if ( op == "&&" ) v = v && r;
+			else if ( op == "|" ) v |= r;
+			else if ( op == "^" ) v ^= r;
+			else if ( op == "&" ) v &= r;
+			else if ( op == "==" ) v = v == r;
+			else if ( op == "!=" ) v = v != r;
+			else if ( op == "<" ) v = v < r;
+			else if ( op == ">" ) v = v > r;
+			else if ( op == "<=" ) v = v <= r;
+			else if ( op == ">=" ) v = v >= r;
+			else if ( op == "<<" ) v = r < 0 || r > 63 ? 0 : (long long)((unsigned long long)v << r);
+			else if ( op == ">>" ) v = r < 0 || r > 63 ? 0 : v >> r;
+			// 加减乘按 64 位补码回绕，溢出不是未定义行为；LLONG_MIN / -1 同样回绕成 LLONG_MIN
+			else if ( op == "+" ) v = (long long)((unsigned long long)v + (unsigned long long)r);
+			else if ( op == "-" ) v = (long long)((unsigned long long)v - (unsigned long long)r);
+			else if ( op == "*" ) v = (long long)((unsigned long long)v * (unsigned long long)r);
+			else if ( r == -1 ) v = op == "/" ? (long long)(0 - (unsigned long long)v) : 0;
+			else if ( op == "/" ) v /= r;
+			else v %= r;
+		}
+	}
+
+	long long cond() {
+		long long c = binary(0);
+		if ( !eat("?") ) return c;
+		long long a = cond();
+		if ( !eat(":") ) bad = true;
+		long long b = cond();
+		return c ? a : b;
+	}
+
+public:
+	explicit pp_expr(string_view text) { pp_words(text, w); }
+
+	bool evaluate(long long& v) {
+		v = cond();
+		return !bad && i == w.size();
+	}
+};
+
+class preprocessor {
+public:
+	struct statistics {
+		size_t files;			// 打开的文件，含主文件
+		size_t cached;			// 其中直接用了缓存的
+		size_t guarded;			// 因保护宏或 #pragma once 跳过的包含
+		size_t expansions;		// 宏展开次数
+	};
+
+private:
+	static constexpr uint32_t none = ~0u;
+	static const int max_depth = 200;		// #include 最多嵌套的层数
+
+	// 宏体在定义它的文件中，文件的 tokens 和 items 还会增长，所以记下标
+	struct macro {
+		const pp_file* f;
+		size_t item;
+	};
+
+	// 隐藏集是 hides 中的链表，0 是空集
+	struct hide_node {
+		uint32_t macro, next;
+	};
+
+	struct pp_token {
+		token tk;
+		uint32_t hide;
+		bool moved;			// 宏展开的结果，位置已改成调用处
+	};
+
+	// 宏展开的输入：先读 stack（末尾先读出），再读 [p, end)，最后读 live 边分析边给出的 token
+	struct pp_input {
+		const token* p = nullptr;
+		const token* end = nullptr;
+		vector<pp_token> stack;
+		texer* live = nullptr;
+
+		bool next(pp_token& t) {
+			if ( !stack.empty() ) {
+				t = stack.back();
+				stack.pop_back();
+				return true;
+			}
+			if ( p != end ) {
+				t = {*p++, 0, false};
+				return true;
+			}
+			if ( live && live->next_token(t.tk) ) {
+				t.hide = 0, t.moved = false;
+				return true;
+			}
+			return false;
+		}
+		// 看下一个 token 但不读出
+		const token* peek() {
+			if ( stack.empty() ) {
+				pp_token t;
+				if ( !next(t) ) return nullptr;
+				stack.emplace_back(t);
+			}
+			return &stack.back().tk;
+		}
+	};
+
+	// 逐项扫描主文件的位置
+	struct pp_scan {
+		size_t row = 0;
+		bool comment = false;	// row 行开始时在块注释中
+		bool text = false;		// 上一项是 f.tx 上的一段普通行，它分析完才知道结尾的注释状态
+	};
+
+	struct cond {
+		bool active;		// 当前分支有效
+		bool taken;			// 已经选过一个分支
+		bool in_else;
+		bool parent;		// 外层有效
+		size_t row;
+	};
+
+	// 正在处理的文件，头文件处理到第 item 项
+	struct frame {
+		const pp_file* f;
+		size_t item;
+		vector<cond> conds;
+	};
+
+	pp_options opt;
+	pp_cache& cache;
+	vector<shared_ptr<pp_file>> used;		// 输出的 token 引用这些文件
+	vector<macro> macros;
+	unordered_map<string_view, uint32_t> defined;
+	vector<hide_node> hides;
+	unordered_set<string> once;
+	symbol_table names;					// 改了位置且值在主文件中的 token，值移到这里
+	vector<pair<string, bool>> probes;	// 找头文件时查看过的路径和是否存在，按顺序、不重复
+	unordered_set<string> probed;
+	pp_file* main = nullptr;
+	pp_scan scan_main;
+	vector<frame> frames;
+	pp_input in;						// 正在读的一段普通行
+	bool reading = false;
+	bool in_header = false;
+	size_t at_row = 0, at_col = 0;		// 正在包含的头文件在主文件中的位置
+	size_t errors = 0;
+	size_t invalid_words = 0;
+	bool stopped = false;				// 不在恢复模式时遇到了非法单词
+	statistics st = {0, 0, 0, 0};
+
+	void error(const pp_file& f, size_t row, const string& msg) {
+		++errors;
+		if ( !f.path.empty() ) *opt.err << f.path << ": ";
+		*opt.err << msg << " at line " << row << cr;
+	}
+
+	void prepare(pp_file&);
+	void lex(pp_file&);
+	int scan(pp_file&, pp_scan&);
+	size_t directive(pp_file&, size_t row, bool& comment);
+	void find_guard(pp_file&);
+
+	shared_ptr<pp_file> load(const string& path);
+	string resolve(const pp_file&, const pp_item&);
+	bool advance();
+	void leave();
+	void run_item(const pp_file&, const pp_item&);
+	void include(const pp_file&, const pp_item&);
+	bool test(const pp_file&, const pp_item&);
+
+	uint32_t lookup(const token& tk) const {
+		if ( defined.empty() || (tk.type != identifier && tk.type != keyword) ) return none;
+		auto it = defined.find(tk.value);
+		return it == defined.end() ? none : it->second;
+	}
+	bool hidden(uint32_t h, uint32_t m) const {
+		for ( ; h; h = hides[h].next )
+			if ( hides[h].macro == m ) return true;
+		return false;
+	}
+	uint32_t hide_add(uint32_t h, uint32_t m) {
+		if ( hidden(h, m) ) return h;
+		hides.push_back({m, h});
+		return hides.size() - 1;
+	}
+	uint32_t hide_union(uint32_t a, uint32_t b) {
+		for ( ; b; b = hides[b].next ) a = hide_add(a, hides[b].macro);
+		return a;
+	}
+	bool expand(const pp_file&, pp_input&, pp_token&);
+	void expand_all(const pp_file&, pp_input&, vector<pp_token>&);
+	bool collect(pp_input&, vector<vector<pp_token>>&);
+	bool emit(const pp_file&, token, bool moved, token& out);
+
+public:
+	explicit preprocessor(const pp_options& o, pp_cache& c = include_cache) : opt(o), cache(c), hides(1, hide_node{none, 0}) {}
+	preprocessor(const preprocessor&) = delete;
+	preprocessor& operator = (const preprocessor&) = delete;
+
+	// 开始预处理主文件，src 是它的内容，path 用来找 "..." 包含的文件，可以为空
+	// 之后用 next 逐个读出结果；读出的 token 引用的头文件归本对象所有
+	void start(const string& path, const source_buffer& src);
+	bool next(token&);
+	size_t error_count() const { return errors; }
+	const statistics& stats() const { return st; }
+	// 输出只取决于主文件和这些路径：它们是否存在、存在时的内容
+	vector<pp_dependency> dependencies() const;
+};
+
+// 非法单词要到输出时才知道是否报告，所以总是用恢复模式分析；
+// 不在恢复模式时第一个输出的非法单词就是终点，它取到和普通分析时一样的长度
+inline void preprocessor::prepare(pp_file& f) {
+	f.tx.use_keywords(opt.keywords);
+	f.tx.recover(0, opt.recover);
+	f.keywords = opt.keywords.slot;
+	f.whole = opt.recover;
+}
+
+// 分析整个头文件，普通行的 token 都放进 tokens
+inline void preprocessor::lex(pp_file& f) {
+	prepare(f);
+	pp_scan s;
+	for ( int k; (k = scan(f, s)) != 0; ) {
+		if ( k != 1 ) continue;
+		pp_item it;
+		it.kind = pp_text;
+		it.first = f.tokens.size();
+		token tk;
+		while ( f.tx.next_token(tk) )
+			f.tokens.emplace_back(tk);
+		it.last = f.tokens.size();
+		if ( it.last > it.first ) f.items.emplace_back(move(it));
+	}
+	find_guard(f);
+}
+
+// 找文件中的下一项：返回 0 表示文件结束，1 表示一段普通行，已在 f.tx 上准备好，要分析完才能再调用；
+// 2 表示一条指令，已放到 items 末尾。块注释中以 # 开头的行不是指令，要等前面一段分析完才知道
+inline int preprocessor::scan(pp_file& f, pp_scan& s) {
+	const source_buffer& b = *f.text;
+	size_t n = b.lines();
+	for ( ;; ) {
+		if ( s.text ) {
+			s.text = false;
+			s.comment = f.tx.comment_open();
+			if ( s.comment ) continue;
+		}
+		else if ( s.row < n ) {
+			size_t r = s.row, d = r + (s.comment && pp_directive_line(b[r]));
+			while ( d < n && !pp_directive_line(b[d]) ) ++d;
+			if ( d > r ) {
+				size_t end = d < n ? b.offset(d) : b.end() - b.begin();
+				f.tx.init(b.begin() + b.offset(r), end - b.offset(r), r, s.comment, true);
+				s.row = d;
+				s.text = true;
+				return 1;
+			}
+		}
+		if ( s.row >= n ) return 0;
+		s.row = directive(f, s.row, s.comment);
+		return 2;
+	}
+}
+// 解析从 row 行开始的一条指令，返回它之后的行号
+inline size_t preprocessor::directive(pp_file& f, size_t row, bool& comment) {
+	const source_buffer& b = *f.text;
+	size_t n = b.lines(), e = row;
+	string_view text = b[row];
+	if ( !text.empty() && text.back() == default_spec.continuation ) {
+		string joined;
+		for ( ; e < n; ++e ) {
+			string_view line = b[e];
+			bool more = !line.empty() && line.back() == default_spec.continuation;
+			joined += more ? line.substr(0, line.size() - 1) : line;
+			if ( !more ) break;
+		}
+		e = min(e, n - 1);
+		f.lines.emplace_back(move(joined));
+		text = f.lines.back();
+	}
+	comment = pp_opens_comment(text);
+
+	auto blank = [&](size_t i) {
+		while ( i < text.size() && (text[i] == ' ' || text[i] == '\t') ) ++i;
+		return i;
+	};
+	auto ident = [&](size_t& i) {
+		size_t b = i;
+		while ( i < text.size() && (isalnum((unsigned char)text[i]) || text[i] == '_') ) ++i;
+		return text.substr(b, i - b);
+	};
+	pp_item it;
+	it.row = row;
+	it.col = text.find('#');
+	size_t i = blank(it.col + 1);
+	string_view word = ident(i);
+	i = blank(i);
+	it.kind = pp_invalid;
+	it.text = "unknown directive";
+	if ( word.empty() || word == "line" || word == "warning" ) it.kind = pp_ignored;
+	else if ( word == "include" ) {
+		char close = i < text.size() ? (text[i] == '<' ? '>' : text[i] == '"' ? '"' : 0) : 0;
+		size_t j = close ? text.find(close, i + 1) : string_view::npos;
+		if ( j == string_view::npos ) it.text = "#include expects \"FILE\" or <FILE>";
+		else {
+			it.kind = pp_include;
+			it.system = close == '>';
+			it.name = text.substr(i + 1, j - i - 1);
+		}
+	}
+	else if ( word == "define" ) {
+		it.name = ident(i);
+		if ( it.name.empty() ) it.text = "macro name missing";
+		else {
+			it.kind = pp_define;
+			// 名字后紧跟 ( 的是函数式宏
+			if ( i < text.size() && text[i] == '(' ) {
+				it.function = true;
+				i = blank(i + 1);
+				while ( i < text.size() && text[i] != ')' ) {
+					string_view p = ident(i);
+					i = blank(i);
+					if ( p.empty() || i == text.size() || (text[i] != ',' && text[i] != ')') ) {
+						it.kind = pp_invalid;
+						it.text = "bad parameter list";
+						break;
+					}
+					it.params.emplace_back(p);
+					if ( text[i] == ',' ) i = blank(i + 1);
+				}
+				if ( i == text.size() ) {
+					it.kind = pp_invalid;
+					it.text = "bad parameter list";
+				}
+				++i;
+			}
+			// 宏体和普通行一样分析，列号接着指令的这一列
+			if ( it.kind == pp_define && i < text.size() ) {
+				f.tx.init(text.data() + i, text.size() - i, row, false, false, i);
+				it.first = f.tokens.size();
+				token tk;
+				while ( f.tx.next_token(tk) )
+					f.tokens.emplace_back(tk);
+				it.last = f.tokens.size();
+			}
+		}
+	}
+	else if ( word == "undef" || word == "ifdef" || word == "ifndef" ) {
+		it.kind = word == "undef" ? pp_undef : word == "ifdef" ? pp_ifdef : pp_ifndef;
+		it.name = ident(i);
+	}
+	else if ( word == "if" || word == "elif" ) {
+		it.kind = word == "if" ? pp_if : pp_elif;
+		it.text = text.substr(i);
+	}
+	else if ( word == "else" ) it.kind = pp_else;
+	else if ( word == "endif" ) it.kind = pp_endif;
+	else if ( word == "pragma" ) it.kind = ident(i) == "once" ? pp_once : pp_ignored;
+	else if ( word == "error" ) {
+		it.kind = pp_error;
+		it.text = text.substr(i);
+	}
+	f.items.emplace_back(move(it));
+	return e + 1;
+}
+
+// 保护宏：前两条指令是 #ifndef X 和 #define X，与 #ifndef 配对的 #endif 是最后一项，中间没有同层的 #else
+inline void preprocessor::find_guard(pp_file& f) {
+	const vector<pp_item>& v = f.items;
+	if ( v.size() < 3 || v[0].kind != pp_ifndef || v[0].name.empty() ) return;
+	if ( v[1].kind != pp_define || v[1].name != v[0].name ) return;
+	int level = 0;
+	for ( size_t k = 0; k < v.size(); ++k ) {
+		pp_kind kind = v[k].kind;
+		if ( kind == pp_if || kind == pp_ifdef || kind == pp_ifndef ) ++level;
+		else if ( (kind == pp_elif || kind == pp_else) && level == 1 ) return;
+		else if ( kind == pp_endif && --level == 0 ) {
+			if ( k + 1 == v.size() ) f.guard = v[0].name;
+			return;
+		}
+	}
+}
+
+inline shared_ptr<pp_file> preprocessor::load(const string& path) {
+	struct stat s;
+	if ( stat(path.c_str(), &s) < 0 ) return nullptr;
+	shared_ptr<pp_file> f = cache.find(path, s, opt.keywords, opt.recover);
+	if ( f ) ++st.cached;
+	else {
+		f = make_shared<pp_file>();
+		f->path = path;
+		f->mtime = s.st_mtim;
+		f->size = s.st_size;
+		if ( !f->buf.map(path) ) {
+			ifstream ifs = ifstream(path, ios::in | ios::binary);
+			if ( !ifs ) return nullptr;
+			f->buf.load(ifs);
+		}
+		lex(*f);
+		cache.insert(f);
+	}
+	++st.files;
+	used.emplace_back(f);
+	return f;
+}
+
+// "..." 先找包含它的文件所在的目录，再找 include_dirs；<...> 只找 include_dirs
+inline string preprocessor::resolve(const pp_file& f, const pp_item& it) {
+	namespace fs = filesystem;
+	auto exists = [&](const fs::path& p) {
+		error_code ec;
+		bool found = fs::is_regular_file(p, ec);
+		if ( probed.insert(p.string()).second ) probes.emplace_back(p.string(), found);
+		return found;
+	};
+	fs::path name = fs::path(string(it.name));
+	if ( name.is_absolute() ) return exists(name) ? name.lexically_normal().string() : "";
+	if ( !it.system ) {
+		fs::path p = fs::path(f.path).parent_path() / name;
+		if ( exists(p) ) return p.lexically_normal().string();
+	}
+	for ( const string& dir : opt.include_dirs ) {
+		fs::path p = fs::path(dir) / name;
+		if ( exists(p) ) return p.lexically_normal().string();
+	}
+	return "";
+}
+
+inline vector<pp_dependency> preprocessor::dependencies() const {
+	vector<pp_dependency> res;
+	for ( const auto& [path, found] : probes ) {
+		const source_buffer* text = nullptr;
+		string name = filesystem::path(path).lexically_normal().string();
+		if ( found )
+			for ( const auto& f : used )
+				if ( f->path == name ) text = &f->buf;
+		res.push_back({path, text});
+	}
+	return res;
+}
+
+// 处理指令直到一段有效的普通行开始，返回 false 表示全部处理完了
+inline bool preprocessor::advance() {
+	while ( !frames.empty() ) {
+		frame& fr = frames.back();
+		const pp_file& f = *fr.f;
+		const pp_item* it = nullptr;
+		bool active = fr.conds.empty() || fr.conds.back().active;
+		if ( &f == main ) {
+			int k = scan(*main, scan_main);
+			if ( k == 1 ) {
+				if ( active ) {
+					in.live = &main->tx;
+					reading = true;
+					return true;
+				}
+				// 跳过的行也要分析完，才知道结尾是否在块注释中
+				token tk;
+				while ( main->tx.next_token(tk) );
+				continue;
+			}
+			if ( k == 2 ) it = &main->items.back();
+		}
+		else if ( fr.item < f.items.size() ) it = &f.items[fr.item++];
+		if ( !it ) {
+			leave();
+			continue;
+		}
+		switch ( it->kind ) {
+		case pp_if:
+		case pp_ifdef:
+		case pp_ifndef: {
+			bool v = active && test(f, *it);
+			fr.conds.push_back({v, v, false, active, it->row});
+			break;
+		}
+		case pp_elif:
+		case pp_else: {
+			if ( fr.conds.empty() || fr.conds.back().in_else ) {
+				error(f, it->row, it->kind == pp_else ? "#else without #if" : "#elif without #if");
+				break;
+			}
+			cond& c = fr.conds.back();
+			bool v = c.parent && !c.taken && (it->kind == pp_else || test(f, *it));
+			c.active = v;
+			c.taken = c.taken || v;
+			c.in_else = it->kind == pp_else;
+			break;
+		}
+		case pp_endif:
+			if ( fr.conds.empty() ) error(f, it->row, "#endif without #if");
+			else fr.conds.pop_back();
+			break;
+		case pp_text:
+			if ( !active ) break;
+			in.p = f.tokens.data() + it->first;
+			in.end = f.tokens.data() + it->last;
+			in.live = nullptr;
+			reading = true;
+			return true;
+		default:
+			// #include 会压入新的一层，fr 之后不能再用
+			if ( active ) run_item(f, *it);
+		}
+	}
+	return false;
+}
+
+// 一个文件处理完，回到包含它的文件
+inline void preprocessor::leave() {
+	frame& fr = frames.back();
+	if ( !fr.conds.empty() ) error(*fr.f, fr.conds.back().row, "unterminated conditional directive");
+	frames.pop_back();
+	if ( frames.size() == 1 ) in_header = false;
+}
+
+inline void preprocessor::run_item(const pp_file& f, const pp_item& it) {
+	switch ( it.kind ) {
+	case pp_define:
+		defined[it.name] = macros.size();
+		macros.push_back({&f, size_t(&it - f.items.data())});
+		break;
+	case pp_undef:
+		if ( it.name.empty() ) error(f, it.row, "macro name missing");
+		defined.erase(it.name);
+		break;
+	case pp_include:
+		include(f, it);
+		break;
+	case pp_once:
+		once.insert(filesystem::path(f.path).lexically_normal().string());
+		break;
+	case pp_error:
+		error(f, it.row, "#error " + string(it.text));
+		break;
+	case pp_invalid:
+		error(f, it.row, string(it.text));
+		break;
+	default:
+		break;
+	}
+}
+
+inline void preprocessor::include(const pp_file& f, const pp_item& it) {
+	string path = resolve(f, it);
+	// 找不到的系统头文件不算错误，这个词法分析器本来也分析不了它们
+	if ( path.empty() ) {
+		if ( !it.system ) error(f, it.row, "cannot find include file \"" + string(it.name) + "\"");
+		return;
+	}
+	if ( once.count(path) ) {
+		++st.guarded;
+		return;
+	}
+	if ( frames.size() > max_depth ) {
+		error(f, it.row, "#include nested too deeply");
+		return;
+	}
+	shared_ptr<pp_file> g = load(path);
+	if ( !g ) {
+		error(f, it.row, "cannot read include file \"" + path + "\"");
+		return;
+	}
+	if ( !g->guard.empty() && defined.count(g->guard) ) {
+		++st.guarded;
+		return;
+	}
+	if ( frames.size() == 1 ) in_header = true, at_row = it.row, at_col = it.col;
+	frames.push_back({g.get(), 0, {}});
+}
+
+// 求条件的值：先处理 defined，再展开宏，最后求值
+inline bool preprocessor::test(const pp_file& f, const pp_item& it) {
+	if ( it.kind == pp_ifdef || it.kind == pp_ifndef ) {
+		if ( it.name.empty() ) {
+			error(f, it.row, "macro name missing");
+			return false;
+		}
+		return (defined.count(it.name) != 0) == (it.kind == pp_ifdef);
+	}
+	vector<string_view> words;
+	pp_words(it.text, words);
+	vector<token> toks;
+	for ( size_t k = 0; k < words.size(); ++k ) {
+		string_view w = words[k];
+		if ( w == "defined" ) {
+			bool paren = k + 1 < words.size() && words[k + 1] == "(";
+			size_t name = k + 1 + paren;
+			if ( name >= words.size() || (paren && (name + 1 >= words.size() || words[name + 1] != ")")) ) {
+				error(f, it.row, "bad use of defined");
+				return false;
+			}
+			toks.emplace_back(it.row, it.col, number, defined.count(words[name]) ? "1" : "0");
+			k = name + paren;
+			continue;
+		}
+		token_type type = isdigit((unsigned char)w[0]) ? number : isalpha((unsigned char)w[0]) || w[0] == '_' ? identifier : operate;
+		toks.emplace_back(it.row, it.col, type, w);
+	}
+	pp_input input;
+	input.p = toks.data(), input.end = toks.data() + toks.size();
+	vector<pp_token> res;
+	hides.resize(1);
+	expand_all(f, input, res);
+	string text;
+	for ( const pp_token& t : res ) {
+		text += t.tk.value;
+		text += sp;
+	}
+	long long v;
+	if ( !pp_expr(text).evaluate(v) ) {
+		error(f, it.row, "invalid #if expression: " + string(it.text));
+		return false;
+	}
+	return v != 0;
+}
+
+// 读出实参，调用前 in 的下一个是 (，读到配对的 ) 为止
+inline bool preprocessor::collect(pp_input& in, vector<vector<pp_token>>& args) {
+	pp_token a;
+	in.next(a);
+	args.assign(1, {});
+	int level = 0;
+	while ( in.next(a) ) {
+		string_view v = a.tk.value;
+		if ( v == "(" ) ++level;
+		else if ( v == ")" && level-- == 0 ) return true;
+		else if ( v == "," && level == 0 ) {
+			args.emplace_back();
+			continue;
+		}
+		args.back().emplace_back(a);
+	}
+	return false;
+}
+
+// 读出 in 展开后的下一个 token，输入读完时返回 false
+// 宏的展开结果放回 in 重新扫描，同一个宏在自己的展开结果中不再展开
+inline bool preprocessor::expand(const pp_file& f, pp_input& in, pp_token& t) {
+	vector<pp_token> body;
+	vector<vector<pp_token>> args, expanded;
+	while ( in.next(t) ) {
+		uint32_t m = lookup(t.tk);
+		if ( m == none || hidden(t.hide, m) ) return true;
+		const pp_file& mf = *macros[m].f;
+		const pp_item& def = mf.items[macros[m].item];
+		const token* mbody = mf.tokens.data() + def.first;
+		size_t length = def.last - def.first;
+		body.clear();
+		if ( !def.function ) {
+			for ( size_t k = 0; k < length; ++k ) body.push_back({mbody[k], 0, true});
+		}
+		else {
+			// 后面不是 ( 时只是一个普通的标识符
+			pp_token name = t;
+			const token* next = in.peek();
+			if ( !next || next->value != "(" ) {
+				t = name;
+				return true;
+			}
+			if ( !collect(in, args) ) {
+				error(f, name.tk.row, "unterminated call to macro " + string(name.tk.value));
+				return false;
+			}
+			const vector<string_view>& params = def.params;
+			if ( params.empty() && args.size() == 1 && args[0].empty() ) args.clear();
+			if ( args.size() != params.size() ) {
+				error(f, name.tk.row, "macro " + string(name.tk.value) + " expects " + to_string(params.size())
+					  + " arguments, got " + to_string(args.size()));
+				continue;
+			}
+			// 实参用到时才展开，每个只展开一次
+			expanded.assign(args.size(), {});
+			vector<char> done(args.size());
+			for ( size_t k = 0; k < length; ++k ) {
+				const token& b = mbody[k];
+				size_t p = find(params.begin(), params.end(), b.value) - params.begin();
+				if ( (b.type != identifier && b.type != keyword) || p == params.size() ) {
+					body.push_back({b, 0, true});
+					continue;
+				}
+				if ( !done[p] ) {
+					pp_input a;
+					a.stack.assign(args[p].rbegin(), args[p].rend());
+					expand_all(f, a, expanded[p]);
+					done[p] = 1;
+				}
+				body.insert(body.end(), expanded[p].begin(), expanded[p].end());
+			}
+			t = name;
+		}
+		uint32_t h = hide_add(t.hide, m);
+		for ( pp_token& b : body ) {
+			b.hide = hide_union(b.hide, h);
+			b.tk.row = t.tk.row, b.tk.col = t.tk.col;
+			b.moved = true;
+		}
+		in.stack.insert(in.stack.end(), body.rbegin(), body.rend());
+		++st.expansions;
+	}
+	return false;
+}
+
+// 展开 in 中的全部宏
+inline void preprocessor::expand_all(const pp_file& f, pp_input& in, vector<pp_token>& res) {
+	pp_token t;
+	while ( expand(f, in, t) ) res.emplace_back(t);
+}
+
+// 非法单词在输出时才报告，位置是它在所在文件中的位置或宏调用处
+inline bool preprocessor::emit(const pp_file& f, token tk, bool moved, token& out) {
+	if ( tk.type == invalid ) {
+		++errors;
+		if ( !opt.recover || invalid_words++ < opt.max_errors ) {
+			if ( in_header ) *opt.err << f.path << ": ";
+			write_diagnostic(*opt.err, tk.row, tk.col, tk.value.substr(0, texer::max_diagnostic_text));
+		}
+		if ( !opt.recover ) {
+			stopped = true;
+			return false;
+		}
+	}
+	if ( in_header ) {
+		tk.row = at_row, tk.col = at_col;
+		moved = true;
+	}
+	// token 表按位置找主文件中的值，位置改了的要把值放到别处
+	const char* p = tk.value.data();
+	if ( moved && p >= main->text->begin() && p < main->text->end() ) tk.value = names.name(names.intern(tk.value));
+	tk.sym = symbol_table::none;
+	out = tk;
+	return true;
+}
+
+inline void preprocessor::start(const string& path, const source_buffer& src) {
+	shared_ptr<pp_file> f = make_shared<pp_file>();
+	f->path = path;
+	f->text = &src;
+	prepare(*f);
+	main = f.get();
+	used.emplace_back(f);
+	++st.files;
+	frames.assign(1, {main, 0, {}});
+}
+
+inline bool preprocessor::next(token& tk) {
+	while ( !stopped ) {
+		if ( !reading ) {
+			if ( advance() ) continue;
+			stopped = true;
+			if ( invalid_words > opt.max_errors ) *opt.err << invalid_words - opt.max_errors << " more errors not shown" << cr;
+			return false;
+		}
+		// 上一个 token 展开完了，之前的隐藏集都不再有用
+		if ( in.stack.empty() ) hides.resize(1);
+		pp_token t;
+		if ( !expand(*frames.back().f, in, t) ) reading = false;
+		else if ( emit(*frames.back().f, t.tk, t.moved, tk) ) return true;
+	}
+	return false;
+}
+
+// 预处理源文件，之后读出的是预处理后的 token，宏展开和头文件的分析都在读出时进行
+// 没有任何指令时不做处理，仍按原来的方式边分析边读出
+inline int texer::preprocess() {
+	if ( fd >= 0 ) return -1;
+	if ( !pp_has_directives(buffer) ) return 0;
+	pp_options opt;
+	opt.keywords = keywords;
+	opt.recover = recovering;
+	opt.max_errors = max_diagnostics;
+	opt.include_dirs = include_dirs;
+	opt.err = err;
+	pp = make_shared<preprocessor>(opt);
+	pp->start(source_path, buffer);
+	return 0;
+}
+
+inline vector<pp_dependency> texer::dependencies() const {
+	return pp ? pp->dependencies() : vector<pp_dependency>();
+}
+
+inline bool texer::next_expanded(token& tk) {
+	if ( !pp->next(tk) ) {
+		if ( pp->error_count() ) failed = true;
+		return false;
+	}
+	if ( symbols ) tk.sym = symbols->intern(tk.value);
+	return true;
+}
+
+#endif
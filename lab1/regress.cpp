@@ -0,0 +1,173 @@
+// 回归检查：每项对应一个修过的问题，全部通过时返回 0
+// 用法: regress
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <climits>
+#include <filesystem>
+#include <unistd.h>
+#include "texer.h"
+#include "batch.h"
+#include "token_cache.h"
+using namespace std;
+
+int failures = 0;
+
+void check(const string& name, bool ok) {
+	cout << (ok ? "ok   " : "FAIL ") << name << cr;
+	if ( !ok ) ++failures;
+}
+
+// 记录完整但值的偏移越出字符串池的缓存条目：打开时拒绝，删掉并算作没命中
+void corrupted_cache_entry(const filesystem::path& tmp) {
+	token_cache cache((tmp / "cache").string());
+	cache.open();
+	cache.configure(builtin_keywords.view(), false);
+	string src = "int g;";
+	uint64_t key = cache.key(src.data(), src.size());
+	cache.store(key, [](token_writer& w) {
+		w.add(0, 0, keyword, "int");
+		w.add(0, 4, identifier, "g");
+		w.add(0, 5, delimiter, ";");
+	});
+	filesystem::path entry;
+	for ( auto& e : filesystem::directory_iterator(tmp / "cache") ) entry = e.path();
+	{
+		fstream f(entry, ios::in | ios::out | ios::binary);
+		uint32_t offset = 0x7fffffff;
+		f.seekp(sizeof(token_file_header) + offsetof(token_record, offset));
+		f.write((const char*)&offset, sizeof(offset));
+	}
+	token_file tf;
+	check("corrupted cache entry is a miss", !cache.find(key, tf) && cache.miss_count() == 1 && cache.hit_count() == 0);
+	check("corrupted cache entry is removed", !filesystem::exists(entry));
+}
+
+// - 和 / 只是操作符的前缀，后面跟着单词字符时整个单词是非法单词，诊断给出整个单词
+void operator_prefix_word() {
+	auto first_error = [](const string& src) {
+		texer tx;
+		ostringstream err;
+		tx.error_stream(err);
+		tx.init(src.data(), src.size(), 0, false, false);
+		for ( const token& tk : tx ) (void)tk;
+		return err.str();
+	};
+	check("-5 is reported as one invalid word", first_error("a = -5;") == "Invalid identifier at line 0, col 4: -5\n");
+	check("--x is reported as one invalid word", first_error("a = --x;") == "Invalid identifier at line 0, col 4: --x\n");
+	check("-= is still an operator", first_error("a -= 5;").empty());
+}
+
+// 有预处理指令的文件：批量和并行分析也先预处理，结果和顺序分析相同
+void preprocessed_batch(const filesystem::path& tmp) {
+	filesystem::path dir = tmp / "pp";
+	filesystem::create_directories(dir);
+	string path = (dir / "x.c").string();
+	ofstream(path) << "#define N 10\na = N;\n#if 0\nb = 1;\n#else\nb = 2;\n#endif\n";
+	auto read = [](const filesystem::path& p) {
+		ifstream ifs(p, ios::in | ios::binary);
+		return string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+	};
+	string sequential;
+	texer tx;
+	tx.init(path);
+	tx.preprocess();
+	for ( const token& tk : tx ) tk.append_to(sequential);
+
+	batch_options opt;
+	opt.chunk_bytes = 8;
+	batch_lexer parallel(opt);
+	parallel.add_file(path, (tmp / "parallel.txt").string(), false);
+	parallel.run(true);
+	opt.out_dir = (tmp / "out").string();
+	batch_lexer batch(opt);
+	batch.add_input(dir.string());
+	batch.run(true);
+
+	check("directives are expanded", sequential.find("number, 10") != string::npos && sequential.find("b = 1") == string::npos
+		&& sequential.find("[3, ") == string::npos);
+	check("parallel lexing preprocesses like sequential", read(tmp / "parallel.txt") == sequential);
+	check("batch lexing preprocesses like sequential", read(tmp / "out" / "x.c.tokens") == sequential);
+}
+
+// 类型越界的记录和旧版本的文件：读端拒绝整个文件
+void bad_token_file(const filesystem::path& tmp) {
+	string path = (tmp / "bad.bin").string();
+	auto write = [&](uint8_t type, uint32_t version) {
+		{
+			token_writer w;
+			w.open(path);
+			w.add(0, 0, identifier, "x");
+		}
+		fstream f(path, ios::in | ios::out | ios::binary);
+		f.seekp(offsetof(token_file_header, version));
+		f.write((const char*)&version, sizeof(version));
+		f.seekp(sizeof(token_file_header) + offsetof(token_record, type));
+		f.write((const char*)&type, sizeof(type));
+	};
+	token_file tf;
+	write(identifier, token_format_version);
+	check("valid token file is accepted", tf.open(path));
+	tf.close();
+	write(token_types, token_format_version);
+	check("token type out of range is rejected", !tf.open(path));
+	write(identifier, token_format_version - 1);
+	check("old token file version is rejected", !tf.open(path));
+}
+
+// 预处理过的条目命中时 .dep 也算刚用过，淘汰时不会先于条目被删
+void cache_hit_touches_dep(const filesystem::path& tmp) {
+	token_cache cache((tmp / "dep-cache").string());
+	cache.open();
+	cache.configure(builtin_keywords.view(), false);
+	string src = "#define X\nint g;";
+	uint64_t key = cache.key(src.data(), src.size(), "");
+	cache.store(key, vector<pp_dependency>(), [](token_writer& w) { w.add(1, 0, keyword, "int"); });
+	filesystem::path dep;
+	for ( auto& e : filesystem::directory_iterator(tmp / "dep-cache") )
+		if ( e.path().extension() == ".dep" ) dep = e.path();
+	auto old = filesystem::file_time_type::clock::now() - chrono::hours(1);
+	filesystem::last_write_time(dep, old);
+	token_file tf;
+	check("preprocessed cache entry hits", cache.find(key, tf, true));
+	check("hit refreshes the .dep file", filesystem::last_write_time(dep) > old + chrono::minutes(30));
+}
+
+// 闭合了的非法字符常量只占到右引号为止，恢复模式下同一行之后的 token 照常读出
+void closed_bad_char_literal() {
+	string src = "c = 'ab'; d = 1;";
+	texer tx;
+	tx.recover(0);
+	tx.init(src.data(), src.size(), 0, false, false);
+	vector<string> values;
+	for ( const token& tk : tx ) values.emplace_back(string(token_type_name[tk.type]) + " " + string(tk.value));
+	vector<string> expect = {"identifier c", "operator =", "invalid 'ab'", "delimiter ;", "identifier d", "operator =", "number 1", "delimiter ;"};
+	check("closed bad char literal stops at its quote", values == expect && tx.error_count() == 1);
+}
+
+// #if 中的溢出按补码回绕，不是未定义行为，LLONG_MIN / -1 也不会触发 SIGFPE
+void pp_expr_overflow() {
+	auto value = [](string_view text, long long expect) {
+		long long v;
+		return pp_expr(text).evaluate(v) && v == expect;
+	};
+	check("#if overflow wraps", value("9223372036854775807 + 1", LLONG_MIN) && value("-(-9223372036854775807 - 1)", LLONG_MIN)
+		&& value("(-9223372036854775807 - 1) * -1", LLONG_MIN) && value("-9223372036854775807 - 2", LLONG_MAX));
+	check("#if LLONG_MIN / -1 and % -1", value("(-9223372036854775807 - 1) / -1", LLONG_MIN)
+		&& value("(-9223372036854775807 - 1) % -1", 0) && value("7 / -1", -7));
+}
+
+int main() {
+	filesystem::path tmp = filesystem::temp_directory_path() / ("texer-regress-" + to_string(getpid()));
+	filesystem::create_directories(tmp);
+	corrupted_cache_entry(tmp);
+	cache_hit_touches_dep(tmp);
+	closed_bad_char_literal();
+	bad_token_file(tmp);
+	pp_expr_overflow();
+	preprocessed_batch(tmp);
+	operator_prefix_word();
+	filesystem::remove_all(tmp);
+	return failures != 0;
+}
@@ -0,0 +1,222 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// token 类型
+enum token_type {
+	keyword,
+	operate,
+	delimiter,
+	identifier,
+	label,
+	literal,
+	number,
+	invalid,		// 恢复模式下的非法单词
+};
+
+// token 类型名称，文本格式和二进制格式共用
+constexpr std::string_view token_type_name[] = {
+	"keyword",
+	"operator",
+	"delimiter",
+	"identifier",
+	"label",
+	"literal",
+	"number",
+	"invalid"
+};
+constexpr int token_types = invalid + 1;
+static_assert(sizeof(token_type_name) / sizeof(token_type_name[0]) == token_types, "one name per token type");
+
+// 词法规格说明
+// 各类单词都在这里声明，编译期据此生成 256 项的字符类表和 DFA 转移表，
+// 每个单词只需按字节走一遍 DFA 即可同时完成识别和分类
+struct token_spec {
+	static constexpr int max_items = 32;
+
+	std::string_view keywords[max_items];
+	int keyword_count;
+	std::string_view operators[max_items];
+	int operator_count;
+	std::string_view delimiters;	// 单字符界符
+	char blank;						// 空白
+	char label_suffix;				// 标签结尾，例如 l1:
+	char continuation;				// 续行符
+	char string_quote;				// 字符串
+	char char_quote;				// 字符，引号内恰好一个字符
+};
+
+constexpr token_spec default_spec = {
+	{"main", "int", "if", "else", "goto", "return", "IF", "ELSE", "THEN", "GOTO"}, 10,
+	{"+", "=", "<", ">", "*", "+=", "-=", "*=", "/=", ">=", "<=", "=="}, 12,
+	"(){},;:\\",
+	' ', ':', '\\', '"', '\''
+};
+
+// 字符类
+enum char_class : uint8_t {
+	c_other,
+	c_blank,
+	c_alpha,		// 字母和下划线
+	c_digit,
+	c_delim,
+	c_colon,
+	c_cont,
+	c_dquote,
+	c_squote,
+	c_op0,			// 之后每个操作符字符各占一类
+};
+
+// DFA 状态
+enum scan_state : uint8_t {
+	s_dead,
+	s_start,
+	s_delim,
+	s_number,
+	s_ident,
+	s_bad,			// 由非法字符组成的单词
+	s_label,
+	s_bad_label,
+	s_string,
+	s_string_end,
+	s_char0,		// 读入了左引号
+	s_char1,		// 读入了一个字符
+	s_char_end,
+	s_char_bad,
+	s_char_bad_end,
+	s_op0,			// 之后是操作符前缀树上的结点
+};
+
+struct dfa_tables {
+	static constexpr int max_class = c_op0 + 16;
+	static constexpr int max_state = s_op0 + 64;
+
+	uint8_t cls[256];
+	uint8_t next[max_state][max_class];
+	int8_t accept[max_state];		// 接受状态对应的 token 类型，-1 表示不接受
+	bool word[max_state];			// 普通单词状态，遇到续行符时需要拼接下一行
+	bool word_char[256];			// 续行拼接时下一行单词可以包含的字符
+	int nclass, nstate;
+};
+
+constexpr dfa_tables build_dfa(const token_spec& spec) {
+	dfa_tables t{};
+
+	// 字符类表
+	for ( int ch = 0; ch < 256; ++ch ) {
+		uint8_t c = c_other;
+		if ( ch == '_' || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ) c = c_alpha;
+		else if ( ch >= '0' && ch <= '9' ) c = c_digit;
+		t.cls[ch] = c;
+	}
+	for ( char ch : spec.delimiters ) t.cls[(uint8_t)ch] = c_delim;
+	t.cls[(uint8_t)spec.blank] = c_blank;
+	t.cls[(uint8_t)spec.label_suffix] = c_colon;
+	t.cls[(uint8_t)spec.continuation] = c_cont;
+	t.cls[(uint8_t)spec.string_quote] = c_dquote;
+	t.cls[(uint8_t)spec.char_quote] = c_squote;
+	t.nclass = c_op0;
+	for ( int i = 0; i < spec.operator_count; ++i ) {
+		for ( char ch : spec.operators[i] ) {
+			if ( t.cls[(uint8_t)ch] < c_op0 ) t.cls[(uint8_t)ch] = t.nclass++;
+		}
+	}
+
+	for ( int s = 0; s < dfa_tables::max_state; ++s ) t.accept[s] = -1;
+
+	// 操作符前缀树，结点 k 对应状态 s_op0 + k
+	uint8_t op_single[dfa_tables::max_class] = {};		// 该字符单独就是操作符
+	t.nstate = s_op0;
+	for ( int i = 0; i < spec.operator_count; ++i ) {
+		uint8_t s = s_start;
+		for ( char ch : spec.operators[i] ) {
+			uint8_t c = t.cls[(uint8_t)ch];
+			if ( t.next[s][c] == s_dead ) t.next[s][c] = t.nstate++;
+			s = t.next[s][c];
+		}
+		t.accept[s] = operate;
+		if ( spec.operators[i].length() == 1 ) op_single[t.cls[(uint8_t)spec.operators[i][0]]] = 1;
+	}
+
+	// 普通单词：遇到空白、界符、单字符操作符结束
+	for ( int c = 0; c < t.nclass; ++c ) {
+		bool ends = c == c_blank || c == c_delim || c == c_colon || c == c_cont || op_single[c];
+		if ( ends ) continue;
+		t.next[s_number][c] = c == c_digit ? s_number : c == c_alpha ? s_ident : s_bad;
+		t.next[s_ident][c] = c == c_digit || c == c_alpha ? s_ident : s_bad;
+		t.next[s_bad][c] = s_bad;
+		if ( c == c_other ) t.next[s_start][c] = s_bad;
+	}
+	for ( int ch = 0; ch < 256; ++ch ) {
+		uint8_t c = t.cls[ch];
+		t.word_char[ch] = t.next[s_bad][c] == s_bad;
+	}
+	// 只是操作符前缀、本身不是操作符的结点（例如 - 和 /）后面跟着单词字符时，
+	// 整个单词都是非法单词，和这些字符不在操作符中时一样，例如 -5、--
+	for ( int s = s_op0; s < t.nstate; ++s ) {
+		if ( t.accept[s] >= 0 ) continue;
+		for ( int c = 0; c < t.nclass; ++c )
+			if ( t.next[s][c] == s_dead && t.next[s_bad][c] == s_bad ) t.next[s][c] = s_bad;
+	}
+	t.next[s_start][c_digit] = s_number;
+	t.next[s_start][c_alpha] = s_ident;
+	t.next[s_number][c_colon] = s_label;
+	t.next[s_ident][c_colon] = s_label;
+	t.next[s_bad][c_colon] = s_bad_label;
+	t.word[s_number] = t.word[s_ident] = t.word[s_bad] = true;
+	t.word[s_label] = t.word[s_bad_label] = true;
+
+	// 界符
+	t.next[s_start][c_delim] = s_delim;
+	t.next[s_start][c_colon] = s_delim;
+	t.next[s_start][c_cont] = s_delim;
+
+	// 字符串和字符，只在一行之内
+	t.next[s_start][c_dquote] = s_string;
+	t.next[s_start][c_squote] = s_char0;
+	for ( int c = 0; c < t.nclass; ++c ) {
+		t.next[s_string][c] = c == c_dquote ? s_string_end : s_string;
+		t.next[s_char0][c] = c == c_squote ? s_char_bad_end : s_char1;
+		t.next[s_char1][c] = c == c_squote ? s_char_end : s_char_bad;
+		t.next[s_char_bad][c] = c == c_squote ? s_char_bad_end : s_char_bad;
+	}
+
+	t.accept[s_delim] = delimiter;
+	t.accept[s_number] = number;
+	t.accept[s_ident] = identifier;
+	t.accept[s_label] = label;
+	t.accept[s_string_end] = literal;
+	t.accept[s_char_end] = literal;
+	return t;
+}
+
+constexpr dfa_tables dfa = build_dfa(default_spec);
+
+struct scan_result {
+	size_t len;		// 消耗的字节数
+	int type;		// token 类型，-1 表示非法单词
+	bool word;		// 停在普通单词状态
+	bool open;		// 停在字符串或字符常量中，没读到右引号
+};
+
+// 从 p 开始识别一个单词，最多读到 end
+inline scan_result scan(const char* p, const char* end) {
+	uint8_t s = s_start;
+	const char* q = p;
+	while ( q < end ) {
+		uint8_t t = dfa.next[s][dfa.cls[(uint8_t)*q]];
+		if ( t == s_dead ) break;
+		s = t, ++q;
+	}
+	bool open = s == s_string || s == s_char0 || s == s_char1 || s == s_char_bad;
+	return { size_t(q - p), dfa.accept[s], dfa.word[s], open };
+}
+
+inline scan_result scan(std::string_view str) {
+	return scan(str.data(), str.data() + str.length());
+}
+
+#endif
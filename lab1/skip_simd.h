@@ -0,0 +1,134 @@
+#ifndef SKIP_SIMD_H
+#define SKIP_SIMD_H
+
+#include <cstring>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SKIP_X86 1
+#endif
+
+// texer::skip 和行索引用到的字节扫描原语
+// 每种实现都返回第一个满足条件的位置，找不到时返回 end，结果与标量版本完全一致
+struct skip_engine {
+	const char* name;
+	const char* (*find_not_blank)(const char*, const char*, char);	// 第一个不是 blank 的字节
+	const char* (*find_comment_end)(const char*, const char*);		// "*/" 中 '*' 的位置
+	const char* (*find_newline)(const char*, const char*);			// 第一个 '\n'
+};
+
+// 标量实现
+inline const char* scalar_find_not_blank(const char* p, const char* end, char blank) {
+	while ( p < end && *p == blank ) ++p;
+	return p;
+}
+
+inline const char* scalar_find_comment_end(const char* p, const char* end) {
+	while ( p + 1 < end && !(p[0] == '*' && p[1] == '/') ) ++p;
+	return p + 1 < end ? p : end;
+}
+
+inline const char* scalar_find_newline(const char* p, const char* end) {
+	while ( p < end && *p != '\n' ) ++p;
+	return p;
+}
+
+#ifdef SKIP_X86
+// SSE2，每次 16 字节
+inline const char* sse2_find_not_blank(const char* p, const char* end, char blank) {
+	const __m128i b = _mm_set1_epi8(blank);
+	for ( ; p + 16 <= end; p += 16 ) {
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		unsigned mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, b)) & 0xffff;
+		if ( mask ) return p + __builtin_ctz(mask);
+	}
+	return scalar_find_not_blank(p, end, blank);
+}
+
+inline const char* sse2_find_comment_end(const char* p, const char* end) {
+	const __m128i star = _mm_set1_epi8('*'), slash = _mm_set1_epi8('/');
+	for ( ; p + 17 <= end; p += 16 ) {
+		__m128i a = _mm_loadu_si128((const __m128i*)p);
+		__m128i b = _mm_loadu_si128((const __m128i*)(p + 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, star), _mm_cmpeq_epi8(b, slash)));
+		if ( mask ) return p + __builtin_ctz(mask);
+	}
+	return scalar_find_comment_end(p, end);
+}
+
+inline const char* sse2_find_newline(const char* p, const char* end) {
+	const __m128i nl = _mm_set1_epi8('\n');
+	for ( ; p + 16 <= end; p += 16 ) {
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl));
+		if ( mask ) return p + __builtin_ctz(mask);
+	}
+	return scalar_find_newline(p, end);
+}
+
+// AVX2，每次 32 字节
+__attribute__((target("avx2")))
+inline const char* avx2_find_not_blank(const char* p, const char* end, char blank) {
+	const __m256i b = _mm256_set1_epi8(blank);
+	for ( ; p + 32 <= end; p += 32 ) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, b));
+		if ( mask ) return p + __builtin_ctz(mask);
+	}
+	return sse2_find_not_blank(p, end, blank);
+}
+
+__attribute__((target("avx2")))
+inline const char* avx2_find_comment_end(const char* p, const char* end) {
+	const __m256i star = _mm256_set1_epi8('*'), slash = _mm256_set1_epi8('/');
+	for ( ; p + 33 <= end; p += 32 ) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)p);
+		__m256i b = _mm256_loadu_si256((const __m256i*)(p + 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, star), _mm256_cmpeq_epi8(b, slash)));
+		if ( mask ) return p + __builtin_ctz(mask);
+	}
+	return sse2_find_comment_end(p, end);
+}
+
+__attribute__((target("avx2")))
+inline const char* avx2_find_newline(const char* p, const char* end) {
+	const __m256i nl = _mm256_set1_epi8('\n');
+	for ( ; p + 32 <= end; p += 32 ) {
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), nl));
+		if ( mask ) return p + __builtin_ctz(mask);
+	}
+	return sse2_find_newline(p, end);
+}
+#endif
+
+constexpr skip_engine scalar_skip = { "scalar", scalar_find_not_blank, scalar_find_comment_end, scalar_find_newline };
+#ifdef SKIP_X86
+constexpr skip_engine sse2_skip = { "sse2", sse2_find_not_blank, sse2_find_comment_end, sse2_find_newline };
+constexpr skip_engine avx2_skip = { "avx2", avx2_find_not_blank, avx2_find_comment_end, avx2_find_newline };
+#endif
+
+// 按 CPUID 选择可用的最快实现
+inline skip_engine select_skip_engine() {
+#ifdef SKIP_X86
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") ) return avx2_skip;
+	if ( __builtin_cpu_supports("sse2") ) return sse2_skip;
+#endif
+	return scalar_skip;
+}
+
+inline skip_engine skipper = select_skip_engine();
+
+// 按名字指定实现，CPU 不支持或名字未知时返回 false
+inline bool use_skip_engine(const std::string& name) {
+	skip_engine best = select_skip_engine();
+	if ( name == "scalar" ) skipper = scalar_skip;
+#ifdef SKIP_X86
+	else if ( name == "sse2" && __builtin_cpu_supports("sse2") ) skipper = sse2_skip;
+	else if ( name == "avx2" && __builtin_cpu_supports("avx2") ) skipper = avx2_skip;
+#endif
+	else if ( name == "auto" ) skipper = best;
+	else return false;
+	return true;
+}
+
+#endif
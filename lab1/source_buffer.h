@@ -0,0 +1,139 @@
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <istream>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "token.h"
+#include "scanner.h"
+#include "skip_simd.h"
+using namespace std;
+
+// 源文件缓冲区：整个文件是一块连续内存（优先 mmap），另建行首索引
+class source_buffer {
+	typedef size_t size_type;
+
+private:
+	const char* data;
+	size_type size;
+	bool mapped;
+	string owned;					// 非 mmap 模式下持有的文件内容
+	vector<size_type> line_start;	// 每一行在 data 中的起始偏移
+
+	void index_lines();
+
+public:
+	source_buffer() : data(nullptr), size(0), mapped(false) {}
+	source_buffer(const source_buffer&) = delete;
+	source_buffer& operator = (const source_buffer&) = delete;
+	~source_buffer() { release(); }
+
+	bool map(const string&);		// 以 mmap 方式打开文件
+	void load(istream&);			// 把整个流读入一块连续内存
+	void assign(const char*, size_type);	// 使用外部的一块内存，不持有它
+	void release();
+
+	size_type lines() const { return line_start.size(); }
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+	size_type offset(size_type r) const { return line_start[r]; }
+	// 给定偏移所在的行
+	size_type row_of(size_type off) const {
+		return upper_bound(line_start.begin(), line_start.end(), off) - line_start.begin() - 1;
+	}
+	// 第 r 行的内容，不含换行符，与 getline 的结果一致
+	string_view operator [] (size_type r) const {
+		size_type b = line_start[r];
+		size_type e = r + 1 < line_start.size() ? line_start[r + 1] - 1 : size;
+		if ( e == size && e > b && data[e - 1] == cr ) --e;
+		return string_view(data + b, e - b);
+	}
+	// 安全取字符，越界时返回 '\0'
+	char at(size_type r, size_type c) const {
+		if ( r >= line_start.size() ) return 0;
+		string_view line = (*this)[r];
+		return c < line.length() ? line[c] : 0;
+	}
+};
+
+inline void source_buffer::index_lines() {
+	line_start.clear();
+	for ( size_type i = 0; i < size; ) {
+		line_start.emplace_back(i);
+		const char* p = skipper.find_newline(data + i, data + size);
+		if ( p == data + size ) break;
+		i = p - data + 1;
+	}
+}
+
+inline bool source_buffer::map(const string& path) {
+	release();
+	int fd = open(path.c_str(), O_RDONLY);
+	if ( fd < 0 ) return false;
+	struct stat st;
+	if ( fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ) {
+		close(fd);
+		return false;
+	}
+	size = st.st_size;
+	if ( size > 0 ) {
+		void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if ( p == MAP_FAILED ) {
+			close(fd);
+			size = 0;
+			return false;
+		}
+		madvise(p, size, MADV_SEQUENTIAL);
+		data = (const char*)p;
+		mapped = true;
+	}
+	close(fd);
+	index_lines();
+	return true;
+}
+
+inline void source_buffer::load(istream& is) {
+	release();
+	owned.assign(istreambuf_iterator<char>(is), istreambuf_iterator<char>());
+	data = owned.data();
+	size = owned.size();
+	index_lines();
+}
+
+inline void source_buffer::assign(const char* p, size_type len) {
+	release();
+	data = p;
+	size = len;
+	index_lines();
+}
+
+inline void source_buffer::release() {
+	if ( mapped ) munmap((void*)data, size);
+	owned.clear();
+	data = nullptr, size = 0, mapped = false;
+	line_start.clear();
+}
+
+// 在 data 的 (lo, hi] 中找最后一个可以切分的位置：紧跟在换行之后，
+// 且前一行不含续行符（续行会读入下一行的单词），找不到时返回 lo
+inline size_t split_point(const char* data, size_t lo, size_t hi) {
+	size_t i = hi;
+	while ( i > lo && data[i - 1] != cr ) --i;
+	while ( i > lo ) {
+		size_t b = i - 1;
+		while ( b > 0 && data[b - 1] != cr ) --b;
+		if ( !memchr(data + b, default_spec.continuation, i - 1 - b) ) return i;
+		i = b;
+	}
+	return lo;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "keyword_hash.h"
+
+// 符号表：把单词的内容映射成稳定的 32 位编号，相同内容只存一份
+// 字节放在按块分配的内存池里，名字一旦登记就不再移动；
+// 哈希表是开放定址、线性探测，槽里存哈希值的低 32 位和编号，比较字符串前先比哈希，
+// 扩容时也由它重新定位，不用再算字符串的哈希。
+// 不是线程安全的，同时只能有一个线程登记和查询。
+class symbol_table {
+public:
+	static constexpr uint32_t none = ~0u;		// 没有编号
+
+	struct statistics {
+		size_t symbols;			// 不同符号的个数
+		size_t lookups;			// 登记次数
+		size_t bytes;			// 实际存储的字节数
+		size_t saved;			// 重复出现而省下的字节数
+	};
+
+private:
+	struct slot {
+		uint32_t hash;
+		uint32_t id;
+	};
+
+	static constexpr size_t block_size = 64 << 10;
+
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char* cur;				// 当前块中下一个空闲位置
+	size_t left;			// 当前块剩余字节数
+	std::vector<std::string_view> names;
+	std::vector<slot> table;
+	size_t mask;
+	statistics st;
+
+	static uint64_t hash(std::string_view s) { return phf_hash(s, 0); }
+
+	const char* store(std::string_view s) {
+		if ( s.size() > left ) {
+			size_t size = std::max(block_size, s.size());
+			blocks.emplace_back(new char[size]);
+			cur = blocks.back().get();
+			left = size;
+		}
+		char* p = cur;
+		if ( !s.empty() ) memcpy(p, s.data(), s.size());
+		cur += s.size(), left -= s.size();
+		return p;
+	}
+
+	void grow() {
+		std::vector<slot> old(table.size() * 2, slot{0, none});
+		old.swap(table);
+		mask = table.size() - 1;
+		for ( const slot& e : old ) {
+			if ( e.id == none ) continue;
+			size_t i = e.hash & mask;
+			while ( table[i].id != none ) i = (i + 1) & mask;
+			table[i] = e;
+		}
+	}
+
+public:
+	symbol_table() : cur(nullptr), left(0), table(1024, slot{0, none}), mask(1023), st{0, 0, 0, 0} {}
+	symbol_table(const symbol_table&) = delete;
+	symbol_table& operator = (const symbol_table&) = delete;
+
+	// 查到已有的编号，或者登记成新符号
+	uint32_t intern(std::string_view s) {
+		uint64_t h = hash(s);
+		uint32_t tag = uint32_t(h);
+		++st.lookups;
+		size_t i = h & mask;
+		for ( ; table[i].id != none; i = (i + 1) & mask ) {
+			if ( table[i].hash == tag && names[table[i].id] == s ) {
+				st.saved += s.size();
+				return table[i].id;
+			}
+		}
+		uint32_t id = names.size();
+		names.emplace_back(store(s), s.size());
+		table[i] = slot{tag, id};
+		st.bytes += s.size();
+		// 装载率超过一半时扩容
+		if ( names.size() * 2 > table.size() ) grow();
+		return id;
+	}
+
+	// 只查不登记，没有时返回 none
+	uint32_t find(std::string_view s) const {
+		uint64_t h = hash(s);
+		uint32_t tag = uint32_t(h);
+		for ( size_t i = h & mask; table[i].id != none; i = (i + 1) & mask )
+			if ( table[i].hash == tag && names[table[i].id] == s ) return table[i].id;
+		return none;
+	}
+
+	std::string_view name(uint32_t id) const { return names[id]; }
+	size_t size() const { return names.size(); }
+
+	statistics stats() const {
+		statistics res = st;
+		res.symbols = names.size();
+		return res;
+	}
+};
+
+#endif
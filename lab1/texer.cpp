@@ -1,354 +1,237 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <vector>
-#include <set>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "texer.h"
+#include "batch.h"
+#include "token_cache.h"
 using namespace std;
 
-
-const char sp = 32, cr = 10;
-
-// token 类型名称
-string token_type_name[] = {
-	"keyword",
-	"operator",
-	"delimiter",
-	"identifier",
-	"label",
-	"literal",
-	"number"
-};
-
-enum token_type {
-	keyword,
-	operate,
-	delimiter,
-	identifier,
-	label,
-	literal,
-	number,
-};
-
-class token {
-	string::size_type row, col;
-	token_type type;
-	string value;
-
-public:
-	token() {};
-	token(token_type _type, string& _value) {
-		type = _type;
-		value = _value;
-	}
-	token(string::size_type _row, string::size_type _col, token_type _type, string& _value) {
-		row = _row, col = _col;
-		type = _type;
-		value = _value;
-	}
-
-	friend ostream& operator << (ostream& os, token& t) {
-		os << "[" << t.row << ", " << t.col << ", " << token_type_name[t.type] << ", " << t.value << "]";
-		return os;
-	}
-};
-
-// 词法分析器类
-class texer {
-	typedef size_t size_type;
-
-private:
-	set<string> keywords;
-	set<string> operators;
-	set<char> delimiters;
-
-	vector<string> buffer;
-	size_type row, col, n;
-
-private:
-	int skip();							// 跳过空白和注释
-	pair<pair<string::size_type, string::size_type>, string> next_word(); // 返回下一个单词的右端，开区间, 以及下一个单词
-	bool is_delimiter(size_type);   	// 判断给定位置处字符是否是界符
-	int is_operator(size_type);		// 判断给定位置处字符是否是操作符
-
-	bool is_delimiter(const string&);	// 判断给定字符串是否是界符
-	bool is_operator(const string&);	// 判断给字符串是否是操作符
-	bool is_number(const string&);		// 判断给定字符串是否是数字
-	bool is_keyword(const string&);		// 判断给定字符串是否是关键字
-	bool is_label(const string&); 		// 判断给定字符串是否是标签
-	bool is_literal(const string&);		// 判断给定字符串是否是字符或字符串
-	bool is_identifier(const string&);	// 判断给定字符串是否是标识符
-
-	void error(string& word) {
-		cout << "Invalid identifier at line " << row << ", col " << col << ": " << word << cr;
-	}
-public:
-	texer() { row = 0, col = 0, n = 0; }
-
-	void init(ifstream&);
-	int preprocess();
-	int get_tokens();
-};
-// 判断给定字符串是否是界符
-bool texer::is_delimiter(const string& str) {
-	return str.length() == 1 && delimiters.find(str[0]) != delimiters.end();
+void print_symbols(const symbol_table& table) {
+	symbol_table::statistics st = table.stats();
+	cout << "symbols: " << st.symbols << ", lookups: " << st.lookups << ", bytes: " << st.bytes
+		 << ", saved: " << st.saved << " bytes" << cr;
 }
-// 判断给字符串是否是操作符
-bool texer::is_operator(const string& str) {
-	bool f = false;
-	f |= operators.find(str.substr(0, 1)) != operators.end();
-	f |= operators.find(str.substr(0, 2)) != operators.end();
-	return f;
+
+void write_table(const token_table& tokens, token_writer& writer) {
+	token tk;
+	for ( token_table::cursor c = tokens.read(); c.next(tk); )
+		writer.add(tk.row, tk.col, tk.type, tk.value);
 }
-// 判断给定字符串是否是数字
-bool texer::is_number(const string& str) {
-	for(char ch : str) {
-		if(!isdigit(ch)) return false;
+
+// 命中缓存时直接写出缓存的 token 流，恢复模式下和分析时一样报告其中的非法单词
+int write_cached(const token_file& tf, bool binary, const string& out_file, size_t max_errors, symbol_table* symbols) {
+	size_t errors = 0;
+	string out;
+	token_writer writer;
+	ofstream ofs;
+	if ( binary ) {
+		if ( !writer.open(out_file.empty() ? "output.bin" : out_file) ) return 1;
 	}
-	return true;
-}
-// 判断给定字符串是否是关键字
-bool texer::is_keyword(const string& str) {
-	return keywords.find(str) != keywords.end();
-}
-// 判断给定字符串是否是标签
-bool texer::is_label(const string& str) {
-	string::size_type len = str.length();
-	if(str[len - 1] == ':' && is_identifier(str.substr(0, len - 1)))
-		return true;
-	return false;
-}
-// 判断给定字符串是否是字符或字符串
-bool texer::is_literal(const string& str) {
-	if(str[0] == '"' && str[str.length() - 1] == '"') return true;
-	if(str.length() == 3 && str[0] == '\'' && str[2] == '\'') return true;
-	return false;
-}
-// 判断给定字符串是否是标识符
-bool texer::is_identifier(const string& str) {
-	// if(str[0] == '_' || isalpha(str[0])) {
-		for(char ch : str) {
-			if(ch != '_' && !isalpha(ch) && !isdigit(ch))
-				return false;
+	else ofs.open(out_file.empty() ? "output.txt" : out_file, ios::out);
+	for ( uint32_t i = 0; i < tf.tokens(); ++i ) {
+		const token_record& r = tf[i];
+		string_view value = tf.value(i);
+		if ( symbols ) symbols->intern(value);
+		if ( r.type == invalid && errors++ < max_errors )
+			write_diagnostic(cout, r.row, r.col, value.substr(0, texer::max_diagnostic_text));
+		if ( binary ) {
+			writer.add(r.row, r.col, r.type, value);
+			continue;
 		}
-		return true;
-	// }
-	// else
-		// return false;
+		token(r.row, r.col, token_type(r.type), value).append_to(out);
+		if ( out.size() >= (1 << 16) ) {
+			ofs.write(out.data(), out.size());
+			out.clear();
+		}
+	}
+	if ( !binary ) ofs.write(out.data(), out.size());
+	if ( errors > max_errors ) cout << errors - max_errors << " more errors not shown" << cr;
+	return 0;
 }
 
-// 跳过空格注释等
-int texer::skip() {
-	bool f = true;
-	while ( f && row < n ) {
-		while(row < n && col >= buffer[row].length() )
-			col = 0, ++row;
-		if ( row >= n ) break;
-		f = false;
-
-		// 跳过空格
-		if ( buffer[row][col] == sp ) {
-			f = true;
-			while ( col < buffer[row].length() && buffer[row][col] == sp )
-				++col;
-		}
-		// 跳过块注释
-		if ( buffer[row][col] == '/' && buffer[row][col + 1] == '*' ) {
-			f = true;
-			col += 2;
-			while ( row < n && !(buffer[row][col] == '*' && buffer[row][col + 1] == '/') ) {
-				++col;
-				if ( col >= buffer[row].length() )
-					col = 0, ++row;
+int main(int argc, char* argv [ ]) {
+	string src = "source.c";
+	string keyword_file;
+	string out_file;
+	bool use_mmap = true, stream = false, binary = false, parallel = false, chunk_set = false, symbols = false;
+	size_t window = texer::window_size, max_errors = 0;
+	string batch_input;
+	vector<string> include_dirs;
+	string cache_dir;
+	uint64_t cache_bytes = token_cache::default_bytes;
+	bool cache_stats = false;
+	batch_options batch;
+	for ( int i = 1; i < argc; ++i ) {
+		string arg = argv[i];
+		if ( arg == "--no-mmap" ) use_mmap = false;
+		else if ( arg == "--stream" ) stream = true;	// 流式读入，src 为 - 时读标准输入
+		else if ( arg == "--format=bin" ) binary = true;		// 二进制 token 流，默认写到 output.bin
+		else if ( arg == "--format=text" ) binary = false;
+		else if ( arg.compare(0, 9, "--window=") == 0 ) window = stoul(arg.substr(9));
+		else if ( arg == "-o" && i + 1 < argc ) out_file = argv[++i];
+		else if ( arg.compare(0, 7, "--skip=") == 0 ) {	// scalar / sse2 / avx2 / auto
+			if ( !use_skip_engine(arg.substr(7)) ) {
+				cout << "Unsupported skip engine " << arg.substr(7) << cr;
+				return 1;
 			}
-			col += 2;
 		}
-		// 跳过宏定义
-		if ( buffer[row][col] == '#' ) {
-			f = true;
-			++row, col = 0;
+		else if ( arg == "--keywords" && i + 1 < argc ) keyword_file = argv[++i];
+		// 预处理时 #include 的查找目录；流式分析不做预处理，批量和并行分析中有预处理指令的文件整个顺序分析
+		else if ( arg == "-I" && i + 1 < argc ) include_dirs.emplace_back(argv[++i]);
+		else if ( arg.compare(0, 2, "-I") == 0 && arg.size() > 2 ) include_dirs.emplace_back(arg.substr(2));
+		else if ( arg == "--symbols" ) symbols = true;		// 登记符号并打印统计
+		// 批量模式：输入是目录或文件列表，-o 指定输出目录
+		else if ( arg == "--batch" && i + 1 < argc ) batch_input = argv[++i];
+		else if ( arg == "--threads" && i + 1 < argc ) batch.threads = stoul(argv[++i]);
+		else if ( arg == "--chunk" && i + 1 < argc ) batch.chunk_bytes = max(1ul, stoul(argv[++i])), chunk_set = true;
+		// 单个文件切段后多线程分析，结果和顺序分析相同
+		else if ( arg == "--parallel" ) parallel = true;
+		// 退出时把热路径计数以 JSON 写到标准错误，编译时要定义 HOTPATH_STATS
+		else if ( arg == "--stats=json" ) atexit([] { write_hot_stats(cerr); });
+		// 遇到非法单词不停止，输出 invalid token 并继续，最后报告前 N 个错误
+		else if ( arg == "--recover" ) max_errors = 1000;
+		else if ( arg.compare(0, 10, "--recover=") == 0 ) max_errors = max(1ul, stoul(arg.substr(10)));
+		// 磁盘 token 缓存：没改过的文件直接读出上次的结果，--cache-size 是上限的 MB 数
+		else if ( arg.compare(0, 8, "--cache=") == 0 ) cache_dir = arg.substr(8);
+		else if ( arg.compare(0, 13, "--cache-size=") == 0 ) cache_bytes = stoull(arg.substr(13)) << 20;
+		else if ( arg == "--cache-stats" ) cache_stats = true;		// 单个文件时也打印缓存命中率
+		else src = arg;
+	}
+
+	texer tx;
+	symbol_table table;
+	if ( symbols ) tx.use_symbols(&table);
+	if ( max_errors ) tx.recover(max_errors);
+	for ( const string& dir : include_dirs ) tx.add_include_dir(dir);
+	batch.max_errors = max_errors;
+	batch.include_dirs = include_dirs;
+	if ( !keyword_file.empty() ) {
+		ifstream ifs = ifstream(keyword_file, ios::in);
+		if ( !ifs || !tx.load_keywords(ifs) ) {
+			cout << "Cannot load keywords from " << keyword_file << cr;
+			return 1;
 		}
-		// 跳过行注释
-		if ( buffer[row][col] == '/' && buffer[row][col + 1] == '/' ) {
-			f = true;
-			++row, col = 0;
+	}
+	// 流式输入读完才知道内容，不用缓存
+	unique_ptr<token_cache> cache;
+	if ( !cache_dir.empty() && !stream ) {
+		cache.reset(new token_cache(cache_dir, cache_bytes));
+		if ( !cache->open() ) {
+			cout << "Cannot open cache " << cache_dir << cr;
+			return 1;
 		}
-		if ( col >= buffer[row].length() )
-			col = 0, ++row;
+		cache->configure(tx.keyword_set(), max_errors > 0);
+		batch.cache = cache.get();
 	}
-	if ( row < n ) return 0;
-	return -1;
-}
-
-// 寻找下一个独立的单词
-pair<pair<string::size_type, string::size_type>, string> texer::next_word() {
-	texer::size_type c = col;
-	// 界符
-	int len = 0;
-	if ( is_delimiter(col) ) {
-		return pair(pair(row, col + 1), buffer[row].substr(col, 1 ));
+	if ( !batch_input.empty() ) {
+		if ( !out_file.empty() ) batch.out_dir = out_file;
+		batch.binary = binary;
+		batch.keywords = tx.keyword_set();
+		batch_lexer bl(batch);
+		if ( !bl.add_input(batch_input) ) {
+			cout << "Cannot read " << batch_input << cr;
+			return 1;
+		}
+		return bl.run();
 	}
-	// 操作符
-	else if ( len = is_operator(col) ) {
-		return pair(pair(row, col + len), buffer[row].substr(col, len));
+	if ( parallel ) {
+		batch.binary = binary;
+		batch.keywords = tx.keyword_set();
+		// 默认每个线程大约分到 8 段，段太小时推测分析的开销不划算
+		if ( !chunk_set ) {
+			size_t threads = batch.threads ? batch.threads : max(1u, thread::hardware_concurrency());
+			error_code ec;
+			size_t size = filesystem::file_size(src, ec);
+			batch.chunk_bytes = max<size_t>(64 << 10, ec ? 0 : size / (threads * 8));
+		}
+		batch_lexer bl(batch);
+		bl.add_file(src, !out_file.empty() ? out_file : binary ? "output.bin" : "output.txt", false);
+		int res = bl.run(true);
+		if ( cache && cache_stats ) cache->write_stats(cout);
+		return res;
 	}
-	// 字符串
-	else if ( buffer[row][col] == '"' || buffer[row][col] == '\'' ) {
-		++c;
-		if ( buffer[row][col] == '"' ) {
-			while ( c < buffer[row].length() && buffer[row][c] != '"' ) ++c;
+	if ( stream ) {
+		int fd = src == "-" ? 0 : open(src.c_str(), O_RDONLY);
+		if ( fd < 0 ) {
+			cout << "Cannot open " << src << cr;
+			return 1;
+		}
+		tx.open(fd, window);
+		// 流式模式默认写到标准输出
+		int res;
+		if ( binary ) {
+			token_writer writer;
+			if ( !writer.open(out_file.empty() ? "output.bin" : out_file) ) return 1;
+			res = tx.get_tokens(writer);
 		}
+		else if ( out_file.empty() || out_file == "-" )
+			res = tx.get_tokens(cout);
 		else {
-			while ( c < buffer[row].length() && buffer[row][c] != '\'' ) ++c;
+			ofstream ofs = ofstream(out_file, ios::out);
+			res = tx.get_tokens(ofs);
 		}
-		return pair(pair(row, c + 1), buffer[row].substr(col, c + 1 - col));
+		if ( fd > 0 ) close(fd);
+		tx.write_diagnostics(cout);
+		if ( symbols ) print_symbols(table);
+		return res < 0;
 	}
-	// 其他情况，遇到界符或空格停止
-	else {
-		size_t r = row;
-		while ( c < buffer[row].length() && buffer[row][c] != sp && !is_delimiter(c) && !is_operator(c) ) 
-			++c;
-		if(c < buffer[row].length() && buffer[row][c] == ':')
-			++c;
-		// 续行
-		if(c < buffer[row].length() && buffer[row][c] == '\\') {
-			string word = buffer[r].substr(col, c - col);
-			word += buffer[r].substr(c + 1);	// 把 '\'后的字符全部加入
-			++r, c = 0;
-			if(r < n) {
-				// 跳过前导空格
-				while(c < buffer[r].length() && buffer[r][c] == sp) 
-					++c;
-				while ( c < buffer[r].length() && buffer[r][c] != sp && !is_delimiter(c) && !is_operator(c) )
-					++c;
-				word += buffer[r].substr(0, c);
-			}
-			return pair(pair(r, c), word);
+	if ( use_mmap ) {
+		if ( !tx.init(src) ) {
+			cout << "Cannot open " << src << cr;
+			return 1;
 		}
-		return pair(pair(row, c), buffer[row].substr(col, c - col));
 	}
-}
-
-bool texer::is_delimiter(texer::size_type index) {
-	return delimiters.find(buffer[row][index]) != delimiters.end();
-}
-
-int texer::is_operator(texer::size_type index) {
-	int res = 0;
-	if(operators.find(buffer[row].substr(index, 1)) != operators.end()) {
-		res = 1;
-		if(index < buffer[row].length() - 1) {
-			if (operators.find(buffer[row].substr(index, 2)) != operators.end())
-				res = 2;
+	else {
+		ifstream file = ifstream(src, ios::in | ios::binary);
+		tx.init(file);
+		file.close();
+	}
+	// 预处理只做准备，token 在读出时才展开，所以可以先预处理再查缓存
+	tx.preprocess();
+	uint64_t key = 0;
+	if ( cache ) {
+		const source_buffer& buf = tx.source();
+		// 预处理的结果还取决于到哪里找头文件
+		if ( tx.preprocessed() ) key = cache->key(buf.begin(), buf.end() - buf.begin(), token_cache::include_context(src, include_dirs));
+		else key = cache->key(buf.begin(), buf.end() - buf.begin());
+		token_file cached;
+		if ( cache->find(key, cached, tx.preprocessed()) ) {
+			int res = write_cached(cached, binary, out_file, max_errors, symbols ? &table : nullptr);
+			if ( symbols ) print_symbols(table);
+			if ( cache_stats ) cache->write_stats(cout);
+			return res;
 		}
 	}
-	return res;
-}
-
-void texer::init(ifstream& src) {
-	string str;
-
-	// 将源文件加载到缓冲区
-	while ( getline(src, str) ) {
-		++n;
-		buffer.emplace_back(str);
+	if ( binary && !cache ) {
+		token_writer writer;
+		if ( !writer.open(out_file.empty() ? "output.bin" : out_file) ) return 1;
+		tx.get_tokens(writer);
 	}
-	// 加载关键字表
-	keywords.insert("main");
-	keywords.insert("int");
-	keywords.insert("if");
-	keywords.insert("else");
-	keywords.insert("goto");
-	keywords.insert("return");
-	keywords.insert("IF");
-	keywords.insert("ELSE");
-	keywords.insert("THEN");
-	keywords.insert("GOTO");
-	// 加载操作符表
-	operators.insert("+");
-	operators.insert("=");
-	operators.insert("<");
-	operators.insert(">");
-	operators.insert("*");
-	operators.insert("+=");
-	operators.insert("-=");
-	operators.insert("*=");
-	operators.insert("/=");
-	operators.insert(">=");
-	operators.insert("<=");
-	operators.insert("==");
-	// 加载界符表
-	delimiters.insert('(');
-	delimiters.insert(')');
-	delimiters.insert('{');
-	delimiters.insert('}');
-	delimiters.insert(',');
-	delimiters.insert(';');
-	delimiters.insert(':');
-	delimiters.insert('\\');
-}
-
-// 预处理
-int texer::preprocess() {
-
-
-	return 0;
-}
-
-// 对源文件进行词法分析
-int texer::get_tokens() {
-	string::size_type l, r;
-	token tk;
-	ofstream ofs = ofstream("output.txt", ios::out);
-
-	while ( row < n ) {
-		if ( skip() < 0 ) break;
-		pair<pair<string::size_type, string::size_type>, string> res = next_word();
-		r = res.first.second;
-		l = col;
-
-		string str = res.second;
-		if(is_delimiter(str))		// 判断是界符
-			tk = token(row, l, token_type::delimiter, str);
-		else if(is_operator(str))	// 判断是操作符
-			tk = token(row, l, token_type::operate, str);
-		else if(is_keyword(str))	// 判断是关键字
-			tk = token(row, l, token_type::keyword, str);
-		else if(is_number(str))		// 判断是数字
-			tk = token(row, l, token_type::number, str);
-		else if(is_literal(str))	// 判断是字符或字符串
-			tk = token(row, l, token_type::literal, str);
-		else if(is_identifier(str)) // 判断是标识符
-			tk = token(row, l, token_type::identifier, str);
-		else if(is_label(str)) {	// 判断是标签
-			string t = str.substr(0, str.length() - 1);
-			tk = token(row, l, token_type::label, t);
+	else {
+		// 先放进列式表，再一次写出
+		token_table tokens(table);
+		int res = tx.get_tokens(tokens);
+		if ( binary ) {
+			token_writer writer;
+			if ( !writer.open(out_file.empty() ? "output.bin" : out_file) ) return 1;
+			write_table(tokens, writer);
+		}
+		else {
+			ofstream ofs = ofstream(out_file.empty() ? "output.txt" : out_file, ios::out);
+			tokens.write(ofs);
 		}
-		else {	// 错误类型，进行错误处理，词法分析结束
-			error(str);
-			break;
+		// 预处理的错误不在 token 中，命中时无法重现，所以预处理过的文件有错误时不存
+		auto fill = [&](token_writer& writer) { write_table(tokens, writer); };
+		if ( cache && tx.preprocessed() ) {
+			if ( res == 0 ) cache->store(key, tx.dependencies(), fill);
 		}
-		// cout << str << cr;
-		ofs << tk << cr;
-		
-		row = res.first.first;
-		col = r;
+		else if ( cache && (res == 0 || max_errors) ) cache->store(key, fill);
 	}
-
+	tx.write_diagnostics(cout);
+	if ( symbols ) print_symbols(table);
+	if ( cache && cache_stats ) cache->write_stats(cout);
 	return 0;
-}
-
-int main(int argc, char* argv [ ]) {
-	string src;
-	if ( argc > 1 ) src = argv[1];
-	else src = "source.c";
-
-	ifstream file = ifstream(src, ios::in);
-
-	texer tx;
-	tx.init(file);
-	tx.preprocess();
-	tx.get_tokens();
-
-
-	file.close();
 }
\ No newline at end of file
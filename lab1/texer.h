@@ -0,0 +1,449 @@
+#ifndef TEXER_H
+#define TEXER_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "token.h"
+#include "scanner.h"
+#include "keyword_hash.h"
+#include "skip_simd.h"
+#include "token_format.h"
+#include "source_buffer.h"
+#include "token_table.h"
+#include "hotpath.h"
+using namespace std;
+
+// 内置关键字表，编译期生成最小完美哈希
+inline constexpr auto builtin_keywords = make_keyword_table<default_spec.keyword_count>(default_spec.keywords);
+
+// 恢复模式下记下的一个词法错误
+struct lex_diagnostic {
+	size_t row, col;
+	string text;		// 非法单词，过长时截断
+};
+
+inline void write_diagnostic(ostream& os, size_t row, size_t col, string_view word) {
+	os << "Invalid identifier at line " << row << ", col " << col << ": " << word << cr;
+}
+
+class preprocessor;
+struct pp_dependency;
+
+// 词法分析器类
+class texer {
+	typedef size_t size_type;
+
+private:
+	keyword_view keywords;
+	keyword_table user_keywords;	// 用户给出的关键字集合，启动时生成完美哈希
+	symbol_table* symbols;		// 不为空时把每个 token 的值登记成符号
+
+	source_buffer buffer;
+	deque<string> spliced;		// 续行拼接出来的单词，token 的值指向这里
+	size_type row, col, n;
+	bool in_comment;			// 块注释跨过了上一个窗口或分段
+	bool more;					// buffer 之后还有输入
+	bool failed;
+	ostream* err;				// 错误信息输出到这里
+
+	// 恢复模式：非法单词作为 invalid token 输出，跳到下一个空白或界符处继续分析，
+	// 错误只记下前 max_diagnostics 个，其余只计数；whole_words 为假时不跳，非法单词只取分析停下前的部分
+	bool recovering;
+	bool whole_words;
+	size_type max_diagnostics;
+	size_type errors;
+	vector<lex_diagnostic> diagnostics;
+
+	// 流式输入：buffer 只是滑动窗口中若干完整的行
+	int fd;
+	bool eof;
+	vector<char> window;
+	size_type window_used;		// window 中已读入的字节数
+	size_type window_cut;		// buffer 覆盖 window 的前 window_cut 字节
+	size_type row_base;			// 窗口第一行在整个输入中的行号
+	size_type col_base;			// 缓冲区从第一行的这一列开始
+
+	// 预处理：源文件路径用来找 "..." 包含的文件，预处理后 token 都从 pp 中读出
+	string source_path;
+	vector<string> include_dirs;
+	shared_ptr<preprocessor> pp;
+
+	// 识别出的一个单词
+	struct word {
+		size_type row, col;		// 单词右端，开区间
+		string_view text;
+		int type;				// token 类型，-1 表示非法单词
+	};
+
+private:
+	int skip();							// 跳过空白和注释
+	void skip_comment(const char*);		// 从给定位置起跳过块注释的剩余部分
+	bool refill();						// 流式输入时滑动窗口
+	word next_word();					// 识别并分类下一个单词
+	bool next_expanded(token&);			// 从预处理器读出下一个 token
+	void resync(word&);					// 把非法单词延长到下一个空白或界符之前
+	bool is_keyword(string_view);		// 判断给定标识符是否是关键字
+
+	size_type file_col() const { return row == 0 ? col_base + col : col; }
+
+	void error(string_view word) {
+		write_diagnostic(*err, row_base + row, file_col(), word);
+	}
+	void record(string_view word) {
+		if ( errors++ < max_diagnostics )
+			diagnostics.push_back({row_base + row, file_col(), string(word.substr(0, max_diagnostic_text))});
+	}
+public:
+	static const size_type window_size = 1 << 20;
+	static const size_type max_diagnostic_text = 64;
+
+	texer() {
+		row = 0, col = 0, n = 0, keywords = builtin_keywords.view();
+		symbols = nullptr;
+		in_comment = more = failed = recovering = whole_words = false;
+		max_diagnostics = errors = 0;
+		err = &cout;
+		fd = -1, eof = false, window_used = window_cut = row_base = col_base = 0;
+	}
+
+	void init(ifstream&);			// 读入流到连续缓冲区
+	bool init(const string&);		// mmap 源文件，失败时退回读流
+	// 只分析一段完整的行，first_row 是它在整个文件中的行号，
+	// comment 表示这一段从块注释内部开始，more 表示这一段之后还有输入，
+	// first_col 不为 0 时这一段从第一行的中间开始，第一行的列号都加上它
+	void init(const char*, size_type, size_type first_row, bool comment, bool more, size_type first_col = 0);
+	void open(int, size_type = window_size);	// 流式读入文件描述符，内存占用与输入大小无关
+	bool load_keywords(ifstream&);	// 用文件中的关键字替换内置关键字表
+	keyword_view keyword_set() const { return keywords; }
+	void use_keywords(keyword_view kw) { keywords = kw; }	// 与其他 texer 共用关键字表
+	void use_symbols(symbol_table* s) { symbols = s; }		// 与分析器共用符号表
+	void error_stream(ostream& os) { err = &os; }
+	bool comment_open() const { return in_comment; }	// 分析完后仍在块注释内
+	const source_buffer& source() const { return buffer; }	// 源文件内容，流式输入时只是当前窗口
+	// 上一个 token 之后的位置，续行拼接的单词结束在下一行
+	size_type next_row() const { return row_base + row; }
+	size_type next_col() const { return file_col(); }
+	bool ok() const { return !failed && errors == 0; }
+	// 打开恢复模式，一遍报告全部非法单词，最多记下 limit 个
+	void recover(size_type limit = 1000, bool whole = true) { recovering = true, whole_words = whole, max_diagnostics = limit; }
+	size_type error_count() const { return errors; }
+	const vector<lex_diagnostic>& diagnostic_list() const { return diagnostics; }
+	void write_diagnostics(ostream&) const;		// 输出记下的错误，超出上限的只给出个数
+	void add_include_dir(const string& dir) { include_dirs.emplace_back(dir); }
+	int preprocess();		// 处理 #include、宏和条件编译，之后读出预处理后的 token，不能用于流式输入
+	bool preprocessed() const { return pp != nullptr; }	// 读出的 token 还取决于头文件和宏
+	vector<pp_dependency> dependencies() const;			// 预处理查看过的头文件路径，读完全部 token 后才完整
+	int get_tokens(ostream&);		// 把全部 token 写到输出流
+	int get_tokens(token_writer&);	// 以二进制格式写出全部 token
+	int get_tokens(token_table&);	// 全部 token 放进列式表，表引用本对象的源文件缓冲区，不能用于流式输入
+
+	// 读出下一个 token，没有更多 token 或出错时返回 false
+	// 流式模式下 token 的值只在下一次调用前有效
+	bool next_token(token&);
+
+	class iterator {
+		texer* tx;
+		token tk;
+	public:
+		iterator(texer* _tx) : tx(_tx) { ++*this; }
+		const token& operator * () const { return tk; }
+		const token* operator -> () const { return &tk; }
+		iterator& operator ++ () {
+			if ( tx && !tx->next_token(tk) ) tx = nullptr;
+			return *this;
+		}
+		bool operator != (const iterator& o) const { return tx != o.tx; }
+	};
+	iterator begin() { return iterator(this); }
+	iterator end() { return iterator(nullptr); }
+};
+// 判断给定标识符是否是关键字
+inline bool texer::is_keyword(string_view str) {
+	return keywords.contains(str);
+}
+
+// 跳过空格注释等
+inline int texer::skip() {
+	HOT_SCOPE(hp_skip);
+	bool f = true;
+	if ( in_comment && row < n ) {
+		in_comment = false;
+		skip_comment(buffer.begin() + buffer.offset(row) + col);
+	}
+	while ( f && row < n ) {
+		while(row < n && col >= buffer[row].length() )
+			col = 0, ++row;
+		if ( row >= n ) break;
+		f = false;
+
+		// 跳过空格
+		string_view line = buffer[row];
+		if ( line[col] == sp ) {
+			f = true;
+			col = skipper.find_not_blank(line.data() + col, line.data() + line.length(), sp) - line.data();
+		}
+		// 跳过块注释，"*/" 不会跨行，可以直接在整个缓冲区上查找
+		if ( buffer.at(row, col) == '/' && buffer.at(row, col + 1) == '*' ) {
+			f = true;
+			skip_comment(line.data() + col + 2);
+		}
+		// 跳过宏定义
+		if ( buffer.at(row, col) == '#' ) {
+			f = true;
+			++row, col = 0;
+		}
+		// 跳过行注释
+		if ( buffer.at(row, col) == '/' && buffer.at(row, col + 1) == '/' ) {
+			f = true;
+			++row, col = 0;
+		}
+		if ( row < n && col >= buffer[row].length() )
+			col = 0, ++row;
+	}
+	if ( row < n ) return 0;
+	return -1;
+}
+
+// 块注释到窗口或分段结尾还没结束时，记下状态留给下一段
+inline void texer::skip_comment(const char* from) {
+	const char* p = skipper.find_comment_end(from, buffer.end());
+	if ( p == buffer.end() ) {
+		row = n, col = 0;
+		in_comment = more;
+	}
+	else {
+		row = buffer.row_of(p - buffer.begin());
+		col = p - buffer.begin() - buffer.offset(row);
+	}
+	col += 2;
+}
+
+// 寻找下一个独立的单词，走一遍 DFA 同时得到它的类型
+inline texer::word texer::next_word() {
+	HOT_SCOPE(hp_next_word);
+	string_view line = buffer[row];
+	scan_result res = scan(line.substr(col));
+	size_type c = col + res.len;
+
+	// 续行，只有这里需要把字节拷贝出来拼接
+	if ( res.word && c < line.length() && line[c] == default_spec.continuation ) {
+		string str = string(line.substr(col, c - col));
+		str += line.substr(c + 1);	// 把 '\'后的字符全部加入
+		size_type r = row + 1;
+		c = 0;
+		if ( r < n ) {
+			string_view next = buffer[r];
+			// 跳过前导空格
+			while ( c < next.length() && next[c] == sp )
+				++c;
+			while ( c < next.length() && dfa.word_char[(uint8_t)next[c]] )
+				++c;
+			str += next.substr(0, c);
+		}
+		spliced.emplace_back(move(str));
+		string_view text = spliced.back();
+		res = scan(text);
+		return { r, c, text, res.len == text.length() ? res.type : -1 };
+	}
+	// 未闭合的字符串一直读到行尾；已经闭合的非法字符常量（如 'ab'）停在右引号之后
+	if ( res.type < 0 && res.open )
+		c = line.length();
+	if ( res.len == 0 ) ++c;
+	return { row, c, line.substr(col, c - col), res.type };
+}
+
+// 续行拼接出的单词已经到了下一行，不再延长
+inline void texer::resync(word& w) {
+	if ( w.row != row ) return;
+	string_view line = buffer[row];
+	size_type c = w.col;
+	while ( c < line.length() ) {
+		uint8_t k = dfa.cls[(uint8_t)line[c]];
+		if ( k == c_blank || k == c_delim || k == c_colon || k == c_cont ) break;
+		++c;
+	}
+	w.col = c;
+	w.text = line.substr(col, c - col);
+}
+
+inline void texer::write_diagnostics(ostream& os) const {
+	for ( const lex_diagnostic& d : diagnostics )
+		write_diagnostic(os, d.row, d.col, d.text);
+	if ( errors > diagnostics.size() )
+		os << errors - diagnostics.size() << " more errors not shown" << cr;
+}
+
+inline void texer::init(ifstream& src) {
+	// 将源文件加载到缓冲区
+	buffer.load(src);
+	n = buffer.lines();
+}
+
+inline bool texer::init(const string& path) {
+	// 将源文件映射到内存，映射失败时按流读入
+	if ( !buffer.map(path) ) {
+		ifstream src = ifstream(path, ios::in | ios::binary);
+		if ( !src ) return false;
+		buffer.load(src);
+	}
+	n = buffer.lines();
+	source_path = path;
+	return true;
+}
+
+inline void texer::init(const char* p, size_type len, size_type first_row, bool comment, bool _more, size_type first_col) {
+	buffer.assign(p, len);
+	n = buffer.lines();
+	row = col = 0;
+	row_base = first_row;
+	col_base = first_col;
+	in_comment = comment;
+	more = _more;
+}
+
+inline void texer::open(int _fd, size_type size) {
+	fd = _fd;
+	eof = false;
+	window.assign(max<size_type>(size, 16), 0);
+	window_used = window_cut = row_base = 0;
+	row = col = n = 0;
+}
+
+// 丢掉已经分析完的行，把剩下的字节移到窗口开头，再从 fd 读入，
+// 直到窗口中有一段可以安全分析的完整行：最后一行不能以续行符结尾
+inline bool texer::refill() {
+	if ( fd < 0 ) return false;
+	row_base += n;
+	col_base = 0;
+	memmove(window.data(), window.data() + window_cut, window_used - window_cut);
+	window_used -= window_cut;
+	window_cut = 0;
+
+	size_type scanned = 0;
+	while ( window_cut == 0 ) {
+		// 含续行符的行要和下一行留在同一个窗口
+		window_cut = split_point(window.data(), scanned, window_used);
+		if ( window_cut == scanned ) window_cut = 0;
+		if ( eof ) window_cut = window_used;
+		if ( window_cut > 0 || eof ) break;
+		scanned = window_used;
+
+		// 一行比整个窗口还长时才扩大窗口
+		if ( window_used == window.size() )
+			window.resize(window.size() * 2);
+		ssize_t len = read(fd, window.data() + window_used, window.size() - window_used);
+		if ( len < 0 ) {
+			cout << "read error" << cr;
+			eof = true;
+			failed = true;
+			window_used = 0;
+		}
+		else if ( len == 0 ) eof = true;
+		else window_used += len;
+	}
+	if ( window_cut == 0 ) return false;
+
+	buffer.assign(window.data(), window_cut);
+	n = buffer.lines();
+	more = !eof;
+	row = col = 0;
+	spliced.clear();
+	return true;
+}
+
+inline bool texer::load_keywords(ifstream& ifs) {
+	vector<string> words;
+	string str;
+	while ( ifs >> str )
+		words.emplace_back(str);
+	try {
+		user_keywords.build(move(words));
+	}
+	catch ( const exception& e ) {
+		cout << e.what() << cr;
+		return false;
+	}
+	keywords = user_keywords.view();
+	return true;
+}
+
+// 读出下一个 token
+inline bool texer::next_token(token& tk) {
+	if ( pp ) return next_expanded(tk);
+	if ( failed ) return false;
+	if ( fd >= 0 ) spliced.clear();
+	while ( row >= n || skip() < 0 ) {
+		if ( !refill() ) return false;
+	}
+	word w = next_word();
+
+	if ( w.type < 0 ) {	// 错误类型，进行错误处理，不在恢复模式时词法分析结束
+		if ( !recovering ) {
+			error(w.text);
+			failed = true;
+			return false;
+		}
+		if ( whole_words ) resync(w);
+		record(w.text);
+		w.type = invalid;
+	}
+	token_type type = token_type(w.type);
+	string_view str = w.text;
+	{
+		HOT_SCOPE(hp_classify);
+		if ( type == identifier && is_keyword(str) )	// 判断是关键字
+			type = keyword;
+		else if ( type == label )	// 标签去掉结尾的 ':'
+			str = str.substr(0, str.length() - 1);
+		tk = token(row_base + row, file_col(), type, str, symbols ? symbols->intern(str) : symbol_table::none);
+	}
+	HOT_TOKEN(type, str.length());
+
+	row = w.row;
+	col = w.col;
+	return true;
+}
+
+// 对源文件进行词法分析
+inline int texer::get_tokens(ostream& os) {
+	token tk;
+	while ( next_token(tk) ) {
+		HOT_SCOPE(hp_format);
+		os << tk << cr;
+	}
+	return ok() ? 0 : -1;
+}
+
+inline int texer::get_tokens(token_table& table) {
+	if ( fd >= 0 ) return -1;
+	table.attach(buffer);
+	token tk;
+	while ( next_token(tk) )
+		table.add(tk, buffer.offset(tk.row - row_base) + tk.col - (tk.row == row_base ? col_base : 0));
+	return ok() ? 0 : -1;
+}
+
+inline int texer::get_tokens(token_writer& writer) {
+	token tk;
+	while ( next_token(tk) ) {
+		HOT_SCOPE(hp_format);
+		writer.add(tk.row, tk.col, tk.type, tk.value);
+	}
+	return ok() ? 0 : -1;
+}
+
+#include "preprocessor.h"
+
+#endif
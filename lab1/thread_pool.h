@@ -0,0 +1,140 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 工作窃取线程池
+// 每个工作线程有自己的任务队列，从队尾取自己的任务，空闲时从别人的队头偷任务。
+// 任务里可以继续提交任务，提交到当前线程自己的队列。
+class thread_pool {
+public:
+	typedef std::function<void()> task;
+
+	// 每个工作线程的统计
+	struct worker_stats {
+		double busy;		// 执行任务的时间，秒
+		size_t tasks;		// 执行的任务数
+		size_t stolen;		// 其中偷来的任务数
+	};
+
+private:
+	struct worker {
+		std::mutex m;
+		std::deque<task> tasks;
+		worker_stats stats = {0, 0, 0};
+	};
+
+	std::vector<std::unique_ptr<worker>> workers;
+	std::vector<std::thread> threads;
+	std::atomic<size_t> pending;	// 已提交未完成的任务数
+	std::atomic<size_t> next;		// 外部提交时轮流分配
+	std::atomic<bool> stop;
+	std::mutex idle_m;
+	std::condition_variable idle_cv, done_cv;
+
+	static int& current() {
+		static thread_local int id = -1;
+		return id;
+	}
+
+	bool pop(size_t self, task& t) {
+		worker& w = *workers[self];
+		std::lock_guard<std::mutex> lock(w.m);
+		if ( w.tasks.empty() ) return false;
+		t = std::move(w.tasks.back());
+		w.tasks.pop_back();
+		return true;
+	}
+
+	bool steal(size_t self, task& t) {
+		for ( size_t k = 1; k < workers.size(); ++k ) {
+			worker& w = *workers[(self + k) % workers.size()];
+			std::lock_guard<std::mutex> lock(w.m);
+			if ( w.tasks.empty() ) continue;
+			t = std::move(w.tasks.front());
+			w.tasks.pop_front();
+			return true;
+		}
+		return false;
+	}
+
+	void run(size_t self) {
+		current() = self;
+		worker& w = *workers[self];
+		while ( true ) {
+			task t;
+			bool stolen = false;
+			if ( !pop(self, t) ) stolen = steal(self, t);
+			if ( !t ) {
+				std::unique_lock<std::mutex> lock(idle_m);
+				if ( stop ) return;
+				idle_cv.wait_for(lock, std::chrono::milliseconds(1));
+				continue;
+			}
+			auto t0 = std::chrono::steady_clock::now();
+			t();
+			auto t1 = std::chrono::steady_clock::now();
+			w.stats.busy += std::chrono::duration<double>(t1 - t0).count();
+			++w.stats.tasks;
+			w.stats.stolen += stolen;
+			if ( --pending == 0 ) {
+				std::lock_guard<std::mutex> lock(idle_m);
+				done_cv.notify_all();
+			}
+		}
+	}
+
+public:
+	explicit thread_pool(size_t n = 0) : pending(0), next(0), stop(false) {
+		if ( n == 0 ) n = std::max(1u, std::thread::hardware_concurrency());
+		for ( size_t i = 0; i < n; ++i ) workers.emplace_back(new worker);
+		for ( size_t i = 0; i < n; ++i ) threads.emplace_back(&thread_pool::run, this, i);
+	}
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator = (const thread_pool&) = delete;
+
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> lock(idle_m);
+			stop = true;
+		}
+		idle_cv.notify_all();
+		for ( std::thread& t : threads ) t.join();
+	}
+
+	size_t size() const { return workers.size(); }
+
+	void submit(task t) {
+		++pending;
+		int self = current();
+		size_t i = self >= 0 ? size_t(self) : next++ % workers.size();
+		{
+			std::lock_guard<std::mutex> lock(workers[i]->m);
+			workers[i]->tasks.emplace_back(std::move(t));
+		}
+		idle_cv.notify_one();
+	}
+
+	// 等待所有任务（包括任务中提交的任务）完成
+	void wait() {
+		std::unique_lock<std::mutex> lock(idle_m);
+		done_cv.wait(lock, [this]() { return pending == 0; });
+	}
+
+	std::vector<worker_stats> stats() const {
+		std::vector<worker_stats> res;
+		for ( const auto& w : workers ) res.emplace_back(w->stats);
+		return res;
+	}
+};
+
+#endif
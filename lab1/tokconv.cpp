@@ -0,0 +1,57 @@
+// 文本 token 流和二进制 token 流互相转换，调试用
+// 用法: tokconv 输入文件 输出文件
+// 输入是二进制格式时转成文本，否则把文本转成二进制
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "token_format.h"
+using namespace std;
+
+const char cr = 10;
+
+int to_text(const string& in, const string& out) {
+	token_file file;
+	if ( !file.open(in) ) {
+		cout << "Invalid token file " << in << cr;
+		return 1;
+	}
+	ofstream ofs = ofstream(out, ios::out);
+	for ( uint32_t i = 0; i < file.tokens(); ++i ) {
+		const token_record& r = file[i];
+		ofs << "[" << r.row << ", " << r.col << ", " << token_type_name[r.type] << ", " << file.value(i) << "]" << cr;
+	}
+	return 0;
+}
+
+int to_binary(const string& in, const string& out) {
+	ifstream ifs = ifstream(in, ios::in);
+	token_writer writer;
+	if ( !ifs || !writer.open(out) ) {
+		cout << "Cannot open " << (ifs ? out : in) << cr;
+		return 1;
+	}
+	string str;
+	int line = 0;
+	while ( getline(ifs, str) ) {
+		++line;
+		uint32_t row, col;
+		uint8_t type;
+		string_view value;
+		if ( !parse_token_line(str, row, col, type, value) ) {
+			cout << "Invalid token at line " << line << ": " << str << cr;
+			return 1;
+		}
+		writer.add(row, col, type, value);
+	}
+	return writer.close() ? 0 : 1;
+}
+
+int main(int argc, char* argv [ ]) {
+	if ( argc < 3 ) {
+		cout << "usage: tokconv input output" << cr;
+		return 1;
+	}
+	if ( is_token_file(argv[1]) )
+		return to_text(argv[1], argv[2]);
+	return to_binary(argv[1], argv[2]);
+}
@@ -0,0 +1,56 @@
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include "scanner.h"
+#include "symbol_table.h"
+using namespace std;
+
+const char sp = 32, cr = 10;
+
+// token 的值是源文件映射上的切片，只有输出时才真正拷贝字节
+// sym 是值在符号表中的编号，没有登记时为 symbol_table::none
+class token {
+public:
+	string::size_type row, col;
+	token_type type;
+	uint32_t sym = symbol_table::none;
+	string_view value;
+
+	token() {};
+	token(token_type _type, string_view _value) {
+		type = _type;
+		value = _value;
+	}
+	token(string::size_type _row, string::size_type _col, token_type _type, string_view _value, uint32_t _sym = symbol_table::none) {
+		row = _row, col = _col;
+		type = _type;
+		value = _value;
+		sym = _sym;
+	}
+
+	friend ostream& operator << (ostream& os, const token& t) {
+		os << "[" << t.row << ", " << t.col << ", " << token_type_name[t.type] << ", " << t.value << "]";
+		return os;
+	}
+
+	// 追加一行文本格式，与 operator << 加换行的结果相同，不经过 ostream
+	void append_to(string& out) const {
+		char num[24];
+		out += '[';
+		out.append(num, to_chars(num, num + sizeof(num), row).ptr - num);
+		out += ", ";
+		out.append(num, to_chars(num, num + sizeof(num), col).ptr - num);
+		out += ", ";
+		out += token_type_name[type];
+		out += ", ";
+		out += value;
+		out += ']';
+		out += cr;
+	}
+};
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "keyword_hash.h"
+#include "scanner.h"
+#include "token.h"
+#include "token_format.h"
+using namespace std;
+
+// 磁盘上的 token 缓存：没改过的文件不再分析
+// 条目是缓存目录下的 <键>.tok，内容就是二进制 token 流，命中时 mmap 直接读出。
+// 键是文件内容和词法分析器配置（关键字、操作符、界符表和恢复模式）的 64 位哈希，和路径、修改时间无关。
+// 预处理过的文件的输出还取决于头文件：<键>.dep 记下上次预处理时查看过的头文件路径，
+// 条目的键再混入这些路径现在是否存在和内容的哈希，所以头文件改了、新增或删除了都找不到旧条目。
+// 条目先写到同一目录下的临时文件，落盘后再 rename，进程中途退出或断电都不会留下不完整的条目。
+// 命中时把条目（和它的 .dep）的修改时间改成现在，总大小超过上限时按修改时间从旧到新删除，即 LRU。
+// 多个进程可以共用一个目录，删掉别的进程已经 mmap 的条目不影响它读。
+
+// 按 8 字节一组的哈希，各组先单独打散再串起来，乘法链只有一条
+inline uint64_t cache_mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+inline uint64_t cache_hash(const char* p, size_t n, uint64_t seed) {
+	const uint64_t k = 0x9e3779b97f4a7c15ull;
+	uint64_t h = seed ^ (n * k);
+	size_t i = 0;
+	for ( ; i + 8 <= n; i += 8 ) {
+		uint64_t w;
+		memcpy(&w, p + i, 8);
+		h = (h ^ cache_mix(w)) * k;
+	}
+	if ( i < n ) {
+		uint64_t w = 0;
+		memcpy(&w, p + i, n - i);
+		h = (h ^ cache_mix(w)) * k;
+	}
+	return cache_mix(h);
+}
+
+class token_cache {
+	filesystem::path dir;
+	uint64_t max_bytes;
+	uint64_t config = 0;			// 配置的哈希，作为内容哈希的种子
+	atomic<uint64_t> total;			// 目录中条目的大致总字节数，淘汰时重新统计
+	atomic<size_t> hits, misses, stores;
+	mutex evict_lock;
+	atomic<uint32_t> serial;		// 本进程临时文件的编号
+
+	filesystem::path entry(uint64_t key, const char* ext = ".tok") const {
+		static const char digits[] = "0123456789abcdef";
+		char name[17];
+		for ( int i = 0; i < 16; ++i ) name[i] = digits[(key >> (60 - 4 * i)) & 15];
+		name[16] = 0;
+		return dir / (string(name) + ext);
+	}
+
+	filesystem::path temp(const filesystem::path& p) {
+		filesystem::path tmp = p;
+		tmp += ".tmp." + to_string(getpid()) + "." + to_string(serial++);
+		return tmp;
+	}
+
+	// 临时文件落盘后改名，失败时删掉临时文件
+	static bool commit(const filesystem::path& tmp, const filesystem::path& p) {
+		int fd = ::open(tmp.c_str(), O_RDONLY);
+		bool ok = fd >= 0 && fsync(fd) == 0;
+		if ( fd >= 0 ) ::close(fd);
+		error_code ec;
+		if ( ok ) filesystem::rename(tmp, p, ec);
+		if ( !ok || ec ) {
+			filesystem::remove(tmp, ec);
+			return false;
+		}
+		return true;
+	}
+
+	// 把一个查看过的路径混入键，不存在的文件和空文件不同
+	static uint64_t mix_path(uint64_t h, const string& path, const char* data, size_t size, bool found) {
+		h = cache_hash(path.data(), path.size(), h);
+		return found ? cache_hash(data, size, h) : cache_mix(h + 1);
+	}
+
+	// 重新统计总大小；超过上限时删到上限的 90%，留出余量，免得每存一条都要删
+	// 临时文件是写到一半退出的进程留下的，放了一段时间还在就删掉
+	void evict() {
+		lock_guard<mutex> g(evict_lock);
+		struct item {
+			filesystem::file_time_type time;
+			uint64_t size;
+			filesystem::path path;
+		};
+		vector<item> items;
+		uint64_t sum = 0;
+		error_code ec;
+		auto stale = filesystem::file_time_type::clock::now() - chrono::minutes(10);
+		for ( auto& e : filesystem::directory_iterator(dir, ec) ) {
+			error_code e1, e2;
+			auto time = e.last_write_time(e1);
+			uint64_t size = e.file_size(e2);
+			if ( e1 || e2 ) continue;
+			string name = e.path().filename().string();
+			if ( name.find(".tmp.") != string::npos ) {
+				if ( time < stale ) filesystem::remove(e.path(), e1);
+				continue;
+			}
+			if ( e.path().extension() != ".tok" && e.path().extension() != ".dep" ) continue;
+			items.push_back({time, size, e.path()});
+			sum += size;
+		}
+		if ( sum > max_bytes ) {
+			sort(items.begin(), items.end(), [](const item& a, const item& b) { return a.time < b.time; });
+			for ( const item& it : items ) {
+				if ( sum <= max_bytes / 10 * 9 ) break;
+				if ( filesystem::remove(it.path, ec) ) sum -= it.size;
+			}
+		}
+		total = sum;
+	}
+
+public:
+	static const uint64_t default_bytes = 256ull << 20;
+
+	explicit token_cache(const string& _dir, uint64_t _max_bytes = default_bytes)
+		: dir(_dir), max_bytes(_max_bytes), total(0), hits(0), misses(0), stores(0), serial(0) {}
+	token_cache(const token_cache&) = delete;
+	token_cache& operator = (const token_cache&) = delete;
+
+	// 建好目录并统计已有条目，目录不能用时返回 false
+	bool open() {
+		error_code ec;
+		filesystem::create_directories(dir, ec);
+		if ( !filesystem::is_directory(dir, ec) ) return false;
+		evict();
+		return true;
+	}
+
+	// 词法分析器的配置，同一个文件在不同配置下的结果分开存放
+	void configure(keyword_view kw, bool recover) {
+		string s = "v" + to_string(token_format_version) + (recover ? "r" : "") + '\n';
+		for ( uint32_t i = 0; i < kw.n; ++i ) s.append(kw.slot[i]) += '\n';
+		s += '\n';
+		for ( int i = 0; i < default_spec.operator_count; ++i ) s.append(default_spec.operators[i]) += '\n';
+		s.append(default_spec.delimiters) += '\n';
+		s += {default_spec.blank, default_spec.label_suffix, default_spec.continuation, default_spec.string_quote, default_spec.char_quote};
+		config = cache_hash(s.data(), s.size(), 0);
+	}
+
+	uint64_t key(const char* data, size_t size) const { return cache_hash(data, size, config); }
+	// 预处理过的文件的键，context 是影响查找头文件的设置，例如文件所在目录和 -I 目录
+	uint64_t key(const char* data, size_t size, const string& context) const {
+		return cache_hash(data, size, cache_hash(context.data(), context.size(), config ^ 1));
+	}
+	// 影响查找头文件的设置：文件所在目录和 -I 目录
+	static string include_context(const string& path, const vector<string>& include_dirs) {
+		string context = filesystem::path(path).parent_path().string();
+		for ( const string& dir : include_dirs ) context += '\n' + dir;
+		return context;
+	}
+
+	// 命中时打开条目并更新它的修改时间；损坏的条目删掉，当作没命中
+	bool find(uint64_t key, token_file& tf) {
+		filesystem::path p = entry(key);
+		if ( !tf.open(p.string()) ) {
+			error_code ec;
+			if ( filesystem::exists(p, ec) ) filesystem::remove(p, ec);
+			++misses;
+			return false;
+		}
+		error_code ec;
+		filesystem::last_write_time(p, filesystem::file_time_type::clock::now(), ec);
+		++hits;
+		return true;
+	}
+
+	// 预处理过的文件：按 .dep 中的路径现在的状态算出条目的键再找
+	bool find(uint64_t key, token_file& tf, bool expanded) {
+		if ( !expanded ) return find(key, tf);
+		ifstream deps(entry(key, ".dep"), ios::in);
+		if ( !deps ) {
+			++misses;
+			return false;
+		}
+		uint64_t h = key;
+		string path, content;
+		while ( getline(deps, path) ) {
+			error_code ec;
+			ifstream f;
+			bool found = filesystem::is_regular_file(path, ec);
+			if ( found ) f.open(path, ios::in | ios::binary);
+			content.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+			h = mix_path(h, path, content.data(), content.size(), found && f);
+		}
+		if ( !find(h, tf) ) return false;
+		// .dep 和条目一起算作刚用过，否则淘汰时常用条目的 .dep 最先被删，之后一直找不到
+		error_code ec;
+		filesystem::last_write_time(entry(key, ".dep"), filesystem::file_time_type::clock::now(), ec);
+		return true;
+	}
+
+	// fill(token_writer&) 写出全部 token，写完后改名成正式的条目
+	template<class F>
+	bool store(uint64_t key, F fill) {
+		filesystem::path p = entry(key);
+		filesystem::path tmp = temp(p);
+		error_code ec;
+		{
+			token_writer writer;
+			if ( !writer.open(tmp.string()) ) return false;
+			fill(writer);
+			if ( !writer.close() ) {
+				filesystem::remove(tmp, ec);
+				return false;
+			}
+		}
+		uint64_t size = filesystem::file_size(tmp, ec);
+		if ( !commit(tmp, p) ) return false;
+		++stores;
+		if ( (total += size) > max_bytes ) evict();
+		return true;
+	}
+
+	// 预处理过的文件：先写 .dep，再存到混入了各个头文件内容的键下
+	// deps 中每项有 path 和 text，text 是预处理时读到的内容，文件不存在时为空
+	template<class D, class F>
+	bool store(uint64_t key, const vector<D>& deps, F fill) {
+		filesystem::path p = entry(key, ".dep");
+		filesystem::path tmp = temp(p);
+		uint64_t h = key;
+		{
+			ofstream ofs(tmp, ios::out | ios::trunc);
+			for ( const D& d : deps ) {
+				ofs << d.path << '\n';
+				h = d.text ? mix_path(h, d.path, d.text->begin(), d.text->end() - d.text->begin(), true)
+						   : mix_path(h, d.path, nullptr, 0, false);
+			}
+			ofs.close();
+			if ( !ofs ) {
+				error_code ec;
+				filesystem::remove(tmp, ec);
+				return false;
+			}
+		}
+		if ( !commit(tmp, p) ) return false;
+		return store(h, fill);
+	}
+
+	size_t hit_count() const { return hits; }
+	size_t miss_count() const { return misses; }
+	double hit_rate() const { return hits + misses ? double(hits) / (hits + misses) : 0; }
+
+	void write_stats(ostream& os) const {
+		os << "cache: " << hits << " hits, " << misses << " misses, " << stores << " stored, hit rate "
+		   << 100 * hit_rate() << "%, " << total << " bytes" << cr;
+	}
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef TOKEN_FORMAT_H
+#define TOKEN_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scanner.h"
+
+// 二进制 token 流格式，texer 输出、parser 读入
+//
+//   header                    16 字节
+//   token_record[count]       每条定长 20 字节
+//   string pool[pool_size]    所有 token 的值首尾相接
+//
+// 整数都是小端序。版本号变化时读端拒绝旧文件。
+// 版本 2 增加了 invalid 类型；类型不在 token_type 范围内的记录是损坏的，读端拒绝整个文件。
+
+const char token_magic[4] = {'T', 'O', 'K', 'B'};
+const uint32_t token_format_version = 2;
+
+struct token_file_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t count;			// token 条数
+	uint32_t pool_size;		// 字符串池字节数
+};
+
+struct token_record {
+	uint32_t row, col;
+	uint32_t offset;		// 值在字符串池中的偏移
+	uint32_t length;
+	uint8_t type;
+	uint8_t pad[3];
+};
+
+static_assert(sizeof(token_file_header) == 16, "token_file_header must be 16 bytes");
+static_assert(sizeof(token_record) == 20, "token_record must be 20 bytes");
+
+// 写二进制 token 流，记录边写边落盘，字符串池在结束时写到文件尾
+class token_writer {
+	std::ofstream ofs;
+	std::string pool;
+	uint32_t count;
+
+public:
+	token_writer() : count(0) {}
+	~token_writer() { close(); }
+
+	bool open(const std::string& path) {
+		ofs.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		token_file_header h = {};
+		ofs.write((const char*)&h, sizeof(h));	// 先占位，结束时回填
+		pool.clear();
+		count = 0;
+		return bool(ofs);
+	}
+
+	void add(uint32_t row, uint32_t col, uint8_t type, std::string_view value) {
+		token_record r = {};
+		r.row = row, r.col = col, r.type = type;
+		r.offset = pool.size(), r.length = value.length();
+		pool.append(value);
+		ofs.write((const char*)&r, sizeof(r));
+		++count;
+	}
+
+	bool close() {
+		if ( !ofs.is_open() ) return true;
+		ofs.write(pool.data(), pool.size());
+		token_file_header h;
+		memcpy(h.magic, token_magic, 4);
+		h.version = token_format_version;
+		h.count = count;
+		h.pool_size = pool.size();
+		ofs.seekp(0);
+		ofs.write((const char*)&h, sizeof(h));
+		bool ok = bool(ofs);
+		ofs.close();
+		return ok;
+	}
+};
+
+// mmap 读二进制 token 流，解码时不分配内存
+class token_file {
+	const char* data;
+	size_t size;
+	const token_record* records;
+	const char* pool;
+	uint32_t count;
+
+public:
+	token_file() : data(nullptr), size(0), records(nullptr), pool(nullptr), count(0) {}
+	token_file(const token_file&) = delete;
+	token_file& operator = (const token_file&) = delete;
+	~token_file() { close(); }
+
+	// 文件不是合法的二进制 token 流时返回 false，包括记录的值越出字符串池或类型未知
+	bool open(const std::string& path) {
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if ( fd < 0 ) return false;
+		struct stat st;
+		if ( fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(token_file_header) ) {
+			::close(fd);
+			return false;
+		}
+		void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if ( p == MAP_FAILED ) return false;
+		data = (const char*)p;
+		size = st.st_size;
+
+		const token_file_header* h = (const token_file_header*)data;
+		if ( memcmp(h->magic, token_magic, 4) != 0 || h->version != token_format_version
+			|| sizeof(*h) + (uint64_t)h->count * sizeof(token_record) + h->pool_size != size ) {
+			close();
+			return false;
+		}
+		count = h->count;
+		records = (const token_record*)(data + sizeof(*h));
+		pool = (const char*)(records + count);
+		// 每条记录都要落在字符串池内、类型在范围内，读端才能不加检查地使用
+		for ( uint32_t i = 0; i < count; ++i ) {
+			const token_record& r = records[i];
+			if ( (uint64_t)r.offset + r.length > h->pool_size || r.type >= token_types ) {
+				close();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void close() {
+		if ( data ) munmap((void*)data, size);
+		data = nullptr, size = 0, records = nullptr, pool = nullptr, count = 0;
+	}
+
+	uint32_t tokens() const { return count; }
+	const token_record& operator [] (uint32_t i) const { return records[i]; }
+	std::string_view value(uint32_t i) const { return std::string_view(pool + records[i].offset, records[i].length); }
+};
+
+// 判断文件是否以二进制 token 流的魔数开头
+inline bool is_token_file(const std::string& path) {
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	char magic[4] = {};
+	ifs.read(magic, 4);
+	return ifs && memcmp(magic, token_magic, 4) == 0;
+}
+
+// 解析文本格式的一行 [row, col, type, value]，值中可以含有逗号
+inline bool parse_token_line(std::string_view line, uint32_t& row, uint32_t& col, uint8_t& type, std::string_view& value) {
+	if ( line.size() < 2 || line.front() != '[' || line.back() != ']' ) return false;
+	size_t p0 = line.find(','), p1 = line.find(',', p0 + 1), p2 = line.find(',', p1 + 1);
+	if ( p2 == std::string_view::npos ) return false;
+	auto number = [](std::string_view s, uint32_t& v) {
+		v = 0;
+		for ( char ch : s ) {
+			if ( ch == ' ' ) continue;
+			if ( ch < '0' || ch > '9' ) return false;
+			v = v * 10 + (ch - '0');
+		}
+		return true;
+	};
+	if ( !number(line.substr(1, p0 - 1), row) || !number(line.substr(p0 + 1, p1 - p0 - 1), col) ) return false;
+	std::string_view name = line.substr(p1 + 2, p2 - p1 - 2);
+	for ( type = 0; type < token_types; ++type )
+		if ( name == token_type_name[type] ) break;
+	if ( type == token_types ) return false;
+	value = line.substr(p2 + 2, line.size() - 1 - p2 - 2);
+	return true;
+}
+
+#endif
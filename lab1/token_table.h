@@ -0,0 +1,135 @@
+#ifndef TOKEN_TABLE_H
+#define TOKEN_TABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include "arena.h"
+#include "symbol_table.h"
+#include "token.h"
+#include "source_buffer.h"
+#include "hotpath.h"
+
+// 按列存放的 token 表
+// 类型、源文件偏移、长度和符号编号各是一个连续数组，每个 token 13 字节，
+// 只扫一列时不会把其余字段读进缓存。数组从内存池分配，clear 时整体丢掉。
+// 行列号不存，由偏移在源文件的行首索引中查出，所以表要和源文件缓冲区一起使用。
+// 续行拼接出的单词不在源文件中连续出现，它的值登记到符号表中，类型带上 interned 标记。
+class token_table {
+public:
+	static const uint8_t interned = 0x80;
+
+private:
+	arena pool;
+	uint8_t* types;
+	uint32_t* offsets;
+	uint32_t* lengths;
+	uint32_t* syms;
+	size_t count, capacity;
+	const source_buffer* source;
+	symbol_table* symbols;
+
+	template<class T>
+	void move_column(T*& col, size_t n) {
+		T* p = pool.allocate_array<T>(n);
+		if ( count ) memcpy(p, col, count * sizeof(T));
+		col = p;
+	}
+
+	// 容量翻倍，旧数组留在内存池里直到 clear
+	void grow() {
+		size_t n = capacity ? capacity * 2 : 4096;
+		move_column(types, n);
+		move_column(offsets, n);
+		move_column(lengths, n);
+		move_column(syms, n);
+		capacity = n;
+	}
+
+public:
+	explicit token_table(symbol_table& _symbols) : types(nullptr), offsets(nullptr), lengths(nullptr), syms(nullptr),
+		count(0), capacity(0), source(nullptr), symbols(&_symbols) {}
+	token_table(const token_table&) = delete;
+	token_table& operator = (const token_table&) = delete;
+
+	void clear() {
+		pool.reset();
+		types = nullptr, offsets = lengths = syms = nullptr;
+		count = capacity = 0;
+	}
+
+	void attach(const source_buffer& buf) { source = &buf; }
+	const source_buffer* buffer() const { return source; }
+	symbol_table& symbol_set() const { return *symbols; }
+
+	// 加入一个 token，offset 是它在源文件中的起始偏移
+	void add(const token& tk, size_t offset);
+
+	size_t size() const { return count; }
+	static const size_t record_bytes = sizeof(uint8_t) + 3 * sizeof(uint32_t);
+	size_t bytes() const { return count * record_bytes; }		// 已存 token 占用的字节数，不含预留的容量
+	bool empty() const { return count == 0; }
+
+	token_type type(size_t i) const { return token_type(types[i] & ~interned); }
+	uint32_t offset(size_t i) const { return offsets[i]; }
+	uint32_t sym(size_t i) const { return syms[i]; }
+	string_view value(size_t i) const;
+	const uint8_t* type_column() const { return types; }
+
+	// 按顺序读出 token，行号随偏移单调前进，不用每次二分查找
+	class cursor {
+		const token_table* t;
+		size_t i, row;
+	public:
+		explicit cursor(const token_table* _t) : t(_t), i(0), row(0) {}
+		bool next(token&);
+	};
+	cursor read() const { return cursor(this); }
+
+	// 写成和 texer 相同的文本格式
+	void write(ostream&) const;
+};
+
+inline void token_table::add(const token& tk, size_t off) {
+	if ( count == capacity ) grow();
+	const char* p = tk.value.data();
+	bool inside = p >= source->begin() && p + tk.value.size() <= source->end();
+	types[count] = tk.type | (inside ? 0 : interned);
+	offsets[count] = off;
+	lengths[count] = tk.value.size();
+	syms[count] = !inside && tk.sym == symbol_table::none ? symbols->intern(tk.value) : tk.sym;
+	++count;
+}
+
+inline string_view token_table::value(size_t i) const {
+	if ( types[i] & interned ) return symbols->name(syms[i]);
+	return string_view(source->begin() + offsets[i], lengths[i]);
+}
+
+inline bool token_table::cursor::next(token& tk) {
+	if ( i >= t->count ) return false;
+	const source_buffer& buf = *t->source;
+	uint32_t off = t->offsets[i];
+	while ( row + 1 < buf.lines() && buf.offset(row + 1) <= off ) ++row;
+	tk = token(row, off - buf.offset(row), t->type(i), t->value(i), t->syms[i]);
+	++i;
+	return true;
+}
+
+inline void token_table::write(ostream& os) const {
+	string out;
+	token tk;
+	for ( cursor c = read(); c.next(tk); ) {
+		HOT_SCOPE(hp_format);
+		tk.append_to(out);
+		if ( out.size() >= (1 << 16) ) {
+			os.write(out.data(), out.size());
+			out.clear();
+		}
+	}
+	os.write(out.data(), out.size());
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef AST_H
+#define AST_H
+
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../lab1/symbol_table.h"
+
+using namespace std;
+
+// 表达式的语法树
+// 结点放在分块的结点池里，用 32 位下标互相引用，比指针小一半，池整体重置。
+// 重置时保留已经分配的块，同样规模的表达式反复分析时不再分配内存。
+// 同一次分析建出的结点总是在子结点之后创建，这一段里子结点的下标比父结点小，
+// 按下标顺序扫一遍就是自底向上，常量折叠不需要递归。
+// 增量分析（reparse.h）把新分析的子树接到旧的父结点上，之后父结点的下标可能比子结点小，
+// 所以整棵树的遍历（输出、编译、求值）都从根出发、用显式的栈，不依赖下标顺序。
+// 每个结点记着它在输入中覆盖的单词个数（包括套在外面的括号），增量分析按它定位单词。
+
+const uint32_t ast_null = ~0u;
+
+enum ast_kind : uint8_t {
+	ast_name,		// 标识符
+	ast_number,		// 常数，值在 value 中
+	ast_binary		// 二元运算
+};
+
+const uint8_t ast_no_nt = 0xFF;
+
+struct ast_node {
+	ast_kind kind;
+	char op;				// 二元运算的算符：+ - * /
+	uint8_t nt;				// 分析时最后规约成的非终结符在 NT 中的下标，不算外层的 #
+	uint32_t sym;			// 标识符或算符的符号编号，折叠成常数的二元运算仍是算符
+	uint32_t left, right;
+	uint32_t width;			// 覆盖的单词个数
+	uint32_t lead;			// 其中左子树（叶子是它自己）前面的左括号个数
+	int64_t value;
+};
+
+class ast_pool {
+	static const uint32_t block_bits = 14;
+	static const uint32_t block_size = 1u << block_bits;
+
+	vector<unique_ptr<ast_node[]>> blocks;
+	uint32_t count;
+
+public:
+	ast_pool() : count(0) {}
+	ast_pool(const ast_pool&) = delete;
+	ast_pool& operator = (const ast_pool&) = delete;
+
+	// 丢掉全部结点，保留内存
+	void reset() { count = 0; }
+	uint32_t size() const { return count; }
+
+	ast_node& operator [] (uint32_t i) { return blocks[i >> block_bits][i & (block_size - 1)]; }
+	const ast_node& operator [] (uint32_t i) const { return blocks[i >> block_bits][i & (block_size - 1)]; }
+
+	uint32_t add(const ast_node& node) {
+		if ( (count >> block_bits) == blocks.size() )
+			blocks.emplace_back(new ast_node[block_size]);
+		(*this)[count] = node;
+		return count++;
+	}
+
+	uint32_t name(uint32_t sym) { return add({ast_name, 0, ast_no_nt, sym, ast_null, ast_null, 1, 0, 0}); }
+	uint32_t number(uint32_t sym, int64_t value) {
+		return add({ast_number, 0, ast_no_nt, sym, ast_null, ast_null, 1, 0, value});
+	}
+	uint32_t binary(uint32_t sym, char op, uint32_t left, uint32_t right) {
+		return add({ast_binary, op, ast_no_nt, sym, left, right, 0, 0, 0});
+	}
+};
+
+// 数字字面量的值，不是整数时返回 false
+inline bool parse_number(string_view s, int64_t& value) {
+	auto res = from_chars(s.data(), s.data() + s.size(), value);
+	return res.ec == errc() && res.ptr == s.data() + s.size();
+}
+
+// 计算 a op b，除数为 0 或算符不认识时返回 false
+inline bool apply_op(char op, int64_t a, int64_t b, int64_t& res) {
+	switch ( op ) {
+	case '+': res = int64_t(uint64_t(a) + uint64_t(b)); return true;
+	case '-': res = int64_t(uint64_t(a) - uint64_t(b)); return true;
+	case '*': res = int64_t(uint64_t(a) * uint64_t(b)); return true;
+	case '/':
+		if ( b == 0 || (a == INT64_MIN && b == -1) ) return false;
+		res = a / b;
+		return true;
+	}
+	return false;
+}
+
+// 二元运算结点按子结点重新决定是否折叠：两个子结点都是常数时换成常数，否则恢复成二元运算
+// 折叠之后子结点仍然留着，子树被换掉时可以重新折叠。返回是否折叠了
+inline bool refold(ast_pool& pool, uint32_t i) {
+	ast_node& node = pool[i];
+	const ast_node& l = pool[node.left];
+	const ast_node& r = pool[node.right];
+	int64_t value;
+	if ( l.kind == ast_number && r.kind == ast_number && apply_op(node.op, l.value, r.value, value) ) {
+		node.kind = ast_number;
+		node.value = value;
+		return true;
+	}
+	node.kind = ast_binary;
+	return false;
+}
+
+// 常量折叠：从下标 from 开始，两个子结点都是常数的二元运算换成常数，返回折叠掉的结点数
+// [from, size) 要是同一次分析建出的结点，子结点在父结点之前
+inline uint32_t fold_constants(ast_pool& pool, uint32_t from = 0) {
+	uint32_t folded = 0;
+	for ( uint32_t i = from; i < pool.size(); ++i )
+		if ( pool[i].left != ast_null && refold(pool, i) ) folded += 2;
+	return folded;
+}
+
+// 写成带括号的中缀形式，用显式的栈，很深的树也不会栈溢出
+inline void ast_to_string(const ast_pool& pool, uint32_t root, const symbol_table& symbols, string& out) {
+	// 第二个分量：0 刚进入，1 左子树已输出，2 右子树已输出
+	vector<pair<uint32_t, int>> stack;
+	stack.emplace_back(root, 0);
+	while ( !stack.empty() ) {
+		auto& top = stack.back();
+		const ast_node& node = pool[top.first];
+		if ( node.kind != ast_binary ) {
+			if ( node.kind == ast_number && node.left != ast_null ) out += to_string(node.value);
+			else out += symbols.name(node.sym);
+			stack.pop_back();
+			continue;
+		}
+		if ( top.second == 0 ) {
+			out += '(';
+			top.second = 1;
+			stack.emplace_back(node.left, 0);
+		}
+		else if ( top.second == 1 ) {
+			out += node.op;
+			top.second = 2;
+			stack.emplace_back(node.right, 0);
+		}
+		else {
+			out += ')';
+			stack.pop_back();
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EVAL_X86 1
+#endif
+#include "ast.h"
+
+using namespace std;
+
+// 表达式的栈式字节码和批量求值
+// 把语法树编译成后缀形式的指令序列，变量按出现顺序编成槽号。
+// interpret 对一组变量取值逐条执行，是正确性的参照；
+// eval_batch 对成列存放的多组取值一次执行一条指令，每条指令处理一整块数据，
+// 算术在 AVX2 可用时按 4 个 64 位整数一组计算。
+// 运算都是 64 位补码回绕，除数为 0 时结果为 0。
+
+enum opcode : uint8_t {
+	op_const,		// 压入常量 consts[arg]
+	op_load,		// 压入变量 arg
+	op_add,
+	op_sub,
+	op_mul,
+	op_div
+};
+
+struct instr {
+	opcode op;
+	uint32_t arg;
+};
+
+struct program {
+	vector<instr> code;
+	vector<int64_t> consts;
+	vector<uint32_t> vars;		// 每个槽对应的变量符号
+	uint32_t depth = 0;			// 执行时栈的最大深度
+};
+
+inline int64_t eval_div(int64_t a, int64_t b) {
+	if ( b == 0 ) return 0;
+	if ( b == -1 ) return int64_t(0 - uint64_t(a));
+	return a / b;
+}
+
+inline opcode op_of(char op) {
+	switch ( op ) {
+	case '+': return op_add;
+	case '-': return op_sub;
+	case '*': return op_mul;
+	default: return op_div;
+	}
+}
+
+// 后序遍历语法树生成字节码，用显式的栈，不递归
+inline program compile(const ast_pool& pool, uint32_t root) {
+	program prog;
+	vector<pair<uint32_t, bool>> stack;		// (结点, 子结点是否已展开)
+	uint32_t depth = 0;
+	stack.emplace_back(root, false);
+	while ( !stack.empty() ) {
+		auto [k, expanded] = stack.back();
+		stack.pop_back();
+		const ast_node& node = pool[k];
+		if ( node.kind == ast_binary ) {
+			if ( expanded ) {
+				prog.code.push_back({op_of(node.op), 0});
+				--depth;
+				continue;
+			}
+			stack.emplace_back(k, true);
+			stack.emplace_back(node.right, false);
+			stack.emplace_back(node.left, false);
+			continue;
+		}
+		if ( node.kind == ast_number ) {
+			prog.code.push_back({op_const, uint32_t(prog.consts.size())});
+			prog.consts.emplace_back(node.value);
+		}
+		else {
+			uint32_t slot = 0;
+			while ( slot < prog.vars.size() && prog.vars[slot] != node.sym ) ++slot;
+			if ( slot == prog.vars.size() ) prog.vars.emplace_back(node.sym);
+			prog.code.push_back({op_load, slot});
+		}
+		prog.depth = max(prog.depth, ++depth);
+	}
+	return prog;
+}
+
+// 标量解释器，vars[slot] 是变量的值
+inline int64_t interpret(const program& prog, const int64_t* vars) {
+	int64_t stack[64];
+	vector<int64_t> big;
+	int64_t* s = stack;
+	if ( prog.depth > 64 ) {
+		big.resize(prog.depth);
+		s = big.data();
+	}
+	size_t top = 0;
+	for ( const instr& in : prog.code ) {
+		switch ( in.op ) {
+		case op_const: s[top++] = prog.consts[in.arg]; break;
+		case op_load: s[top++] = vars[in.arg]; break;
+		case op_add: --top, s[top - 1] = int64_t(uint64_t(s[top - 1]) + uint64_t(s[top])); break;
+		case op_sub: --top, s[top - 1] = int64_t(uint64_t(s[top - 1]) - uint64_t(s[top])); break;
+		case op_mul: --top, s[top - 1] = int64_t(uint64_t(s[top - 1]) * uint64_t(s[top])); break;
+		case op_div: --top, s[top - 1] = eval_div(s[top - 1], s[top]); break;
+		}
+	}
+	return top ? s[top - 1] : 0;
+}
+
+// 直接在语法树上求值，values[sym] 是符号 sym 的值，作为比较的基线
+inline int64_t eval_tree(const ast_pool& pool, uint32_t root, const int64_t* values) {
+	vector<pair<uint32_t, bool>> stack;
+	vector<int64_t> result;
+	stack.emplace_back(root, false);
+	while ( !stack.empty() ) {
+		auto [k, expanded] = stack.back();
+		stack.pop_back();
+		const ast_node& node = pool[k];
+		if ( node.kind == ast_number ) result.emplace_back(node.value);
+		else if ( node.kind == ast_name ) result.emplace_back(values[node.sym]);
+		else if ( !expanded ) {
+			stack.emplace_back(k, true);
+			stack.emplace_back(node.right, false);
+			stack.emplace_back(node.left, false);
+		}
+		else {
+			int64_t b = result.back();
+			result.pop_back();
+			int64_t& a = result.back();
+			switch ( node.op ) {
+			case '+': a = int64_t(uint64_t(a) + uint64_t(b)); break;
+			case '-': a = int64_t(uint64_t(a) - uint64_t(b)); break;
+			case '*': a = int64_t(uint64_t(a) * uint64_t(b)); break;
+			default: a = eval_div(a, b); break;
+			}
+		}
+	}
+	return result.empty() ? 0 : result.back();
+}
+
+// 一块数据上的算术：a[i] = a[i] op b[i]
+struct eval_engine {
+	const char* name;
+	void (*add)(int64_t*, const int64_t*, size_t);
+	void (*sub)(int64_t*, const int64_t*, size_t);
+	void (*mul)(int64_t*, const int64_t*, size_t);
+	void (*div)(int64_t*, const int64_t*, size_t);
+};
+
+inline void scalar_add(int64_t* a, const int64_t* b, size_t n) {
+	for ( size_t i = 0; i < n; ++i ) a[i] = int64_t(uint64_t(a[i]) + uint64_t(b[i]));
+}
+
+inline void scalar_sub(int64_t* a, const int64_t* b, size_t n) {
+	for ( size_t i = 0; i < n; ++i ) a[i] = int64_t(uint64_t(a[i]) - uint64_t(b[i]));
+}
+
+inline void scalar_mul(int64_t* a, const int64_t* b, size_t n) {
+	for ( size_t i = 0; i < n; ++i ) a[i] = int64_t(uint64_t(a[i]) * uint64_t(b[i]));
+}
+
+// 整数除法没有向量指令，各实现共用
+inline void scalar_div(int64_t* a, const int64_t* b, size_t n) {
+	for ( size_t i = 0; i < n; ++i ) a[i] = eval_div(a[i], b[i]);
+}
+
+#ifdef EVAL_X86
+__attribute__((target("avx2")))
+inline void avx2_add(int64_t* a, const int64_t* b, size_t n) {
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 ) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+		_mm256_storeu_si256((__m256i*)(a + i), _mm256_add_epi64(x, y));
+	}
+	scalar_add(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline void avx2_sub(int64_t* a, const int64_t* b, size_t n) {
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 ) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+		_mm256_storeu_si256((__m256i*)(a + i), _mm256_sub_epi64(x, y));
+	}
+	scalar_sub(a + i, b + i, n - i);
+}
+
+// AVX2 没有 64 位乘法，用 32 位乘法拼出低 64 位：
+// lo(a) * lo(b) + ((hi(a) * lo(b) + lo(a) * hi(b)) << 32)
+__attribute__((target("avx2")))
+inline void avx2_mul(int64_t* a, const int64_t* b, size_t n) {
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 ) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+		__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), y),
+										 _mm256_mul_epu32(x, _mm256_srli_epi64(y, 32)));
+		__m256i res = _mm256_add_epi64(_mm256_mul_epu32(x, y), _mm256_slli_epi64(cross, 32));
+		_mm256_storeu_si256((__m256i*)(a + i), res);
+	}
+	scalar_mul(a + i, b + i, n - i);
+}
+#endif
+
+constexpr eval_engine scalar_eval = { "scalar", scalar_add, scalar_sub, scalar_mul, scalar_div };
+#ifdef EVAL_X86
+constexpr eval_engine avx2_eval = { "avx2", avx2_add, avx2_sub, avx2_mul, scalar_div };
+#endif
+
+// 按 CPUID 选择可用的最快实现
+inline eval_engine select_eval_engine() {
+#ifdef EVAL_X86
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") ) return avx2_eval;
+#endif
+	return scalar_eval;
+}
+
+inline eval_engine evaluator = select_eval_engine();
+
+// 按名字指定实现，CPU 不支持或名字未知时返回 false
+inline bool use_eval_engine(const string& name) {
+	if ( name == "scalar" ) evaluator = scalar_eval;
+#ifdef EVAL_X86
+	else if ( name == "avx2" && __builtin_cpu_supports("avx2") ) evaluator = avx2_eval;
+#endif
+	else if ( name == "auto" ) evaluator = select_eval_engine();
+	else return false;
+	return true;
+}
+
+// 批量求值：columns[slot][i] 是第 i 组取值中变量 slot 的值，结果写到 out[i]
+// 按块处理，块内每条指令扫一遍数据，栈中每一层是一整块
+inline void eval_batch(const program& prog, const int64_t* const* columns, size_t n, int64_t* out) {
+	const size_t block = 512;
+	vector<int64_t> stack(max<size_t>(prog.depth, 1) * block);
+	for ( size_t base = 0; base < n; base += block ) {
+		size_t m = min(block, n - base);
+		size_t top = 0;
+		// 二元运算的左运算对象在次栈顶，右运算对象紧跟其后；只在栈里至少有两层时才算这个地址
+		auto lhs = [&] { return stack.data() + (top - 2) * block; };
+		for ( const instr& in : prog.code ) {
+			int64_t* dst = stack.data() + top * block;
+			switch ( in.op ) {
+			case op_const: fill(dst, dst + m, prog.consts[in.arg]), ++top; break;
+			case op_load: memcpy(dst, columns[in.arg] + base, m * sizeof(int64_t)), ++top; break;
+			case op_add: evaluator.add(lhs(), lhs() + block, m), --top; break;
+			case op_sub: evaluator.sub(lhs(), lhs() + block, m), --top; break;
+			case op_mul: evaluator.mul(lhs(), lhs() + block, m), --top; break;
+			case op_div: evaluator.div(lhs(), lhs() + block, m), --top; break;
+			}
+		}
+		memcpy(out + base, stack.data(), m * sizeof(int64_t));
+	}
+}
+
+#endif
@@ -0,0 +1,105 @@
+// 表达式求值的基准测试
+// 分析源文件中的每个赋值语句，把成功分析的表达式编译成字节码，
+// 对大量变量取值分别在语法树上直接求值、用标量解释器、批量求值器和生成的机器码计算，
+// 核对结果并比较速度。
+// 第一个变量依次取 0, 1, 2, ...，其余变量取由下标算出的值。
+// 用法: exprbench [源文件] [--bindings N] [--engine=scalar|avx2|auto]
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../lab1/texer.h"
+#include "parser.h"
+#include "bytecode.h"
+#include "jit.h"
+
+using namespace std;
+typedef chrono::steady_clock timer;
+
+double seconds(timer::time_point a, timer::time_point b) {
+	return chrono::duration<double>(b - a).count();
+}
+
+int main(int argc, char* argv [ ]) {
+	string path = "../lab1/source1.c";
+	size_t n = 1 << 20;
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if(arg == "--bindings" && i + 1 < argc) n = stoul(argv[++i]);
+		else if(arg.compare(0, 9, "--engine=") == 0) {
+			if(!use_eval_engine(arg.substr(9))) {
+				cout << "Unsupported engine " << arg.substr(9) << cr;
+				return 1;
+			}
+		}
+		else path = arg;
+	}
+
+	texer tx;
+	if(!tx.init(path)) {
+		cout << "Cannot open " << path << cr;
+		return 1;
+	}
+	grammer_init();
+	trace.set_level(trace_none);
+	token_table tokens(symbols);
+	tx.get_tokens(tokens);
+	src.attach(&tokens);
+
+	int mismatched = 0;
+	token tk;
+	while(src.read(tk)) {
+		if(tk.type != token_type::operate || tk.sym != assign_sym || parser() < 0)
+			continue;
+		program prog = compile(work.ast, work.root);
+		string expr;
+		ast_to_string(work.ast, work.root, symbols, expr);
+
+		// 变量取值按列存放
+		vector<vector<int64_t>> columns(prog.vars.size(), vector<int64_t>(n));
+		vector<const int64_t*> cols;
+		for(size_t v = 0; v < columns.size(); ++v) {
+			for(size_t i = 0; i < n; ++i)
+				columns[v][i] = v == 0 ? int64_t(i) : int64_t((i * 2654435761u + v * 40503) % 2001) - 1000;
+			cols.emplace_back(columns[v].data());
+		}
+
+		vector<int64_t> expect(n), got(n), walked(n), native(n), row(prog.vars.size());
+		vector<int64_t> values(symbols.size());
+		native_expr jit(prog);
+		auto tw = timer::now();
+		for(size_t i = 0; i < n; ++i) {
+			for(size_t v = 0; v < row.size(); ++v)
+				values[prog.vars[v]] = columns[v][i];
+			walked[i] = eval_tree(work.ast, work.root, values.data());
+		}
+		auto t0 = timer::now();
+		for(size_t i = 0; i < n; ++i) {
+			for(size_t v = 0; v < row.size(); ++v)
+				row[v] = columns[v][i];
+			expect[i] = interpret(prog, row.data());
+		}
+		auto t1 = timer::now();
+		eval_batch(prog, cols.data(), n, got.data());
+		auto t2 = timer::now();
+		for(size_t i = 0; i < n; ++i) {
+			for(size_t v = 0; v < row.size(); ++v)
+				row[v] = columns[v][i];
+			native[i] = jit(row.data());
+		}
+		auto t3 = timer::now();
+		bool same = expect == got, tree_same = expect == walked, native_same = expect == native;
+		mismatched += !same + !tree_same + !native_same;
+
+		cout << expr << ": " << prog.code.size() << " instructions, " << prog.vars.size() << " variables" << cr;
+		cout << "  tree walk  " << n / seconds(tw, t0) / 1e6 << " M/s" << (tree_same ? "" : "  MISMATCH") << cr;
+		cout << "  interpret  " << n / seconds(t0, t1) / 1e6 << " M/s" << cr;
+		cout << "  batch " << evaluator.name << (string(evaluator.name).size() < 5 ? "  " : " ")
+			 << n / seconds(t1, t2) / 1e6 << " M/s" << (same ? "" : "  MISMATCH") << cr;
+		cout << (jit.native() ? "  native     " : "  fallback   ") << n / seconds(t2, t3) / 1e6 << " M/s"
+			 << (native_same ? "" : "  MISMATCH");
+		if(jit.native()) cout << "  (" << jit.code_size() << " bytes)";
+		cout << cr;
+	}
+	return mismatched > 0;
+}
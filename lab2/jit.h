@@ -0,0 +1,143 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X86_64 1
+#endif
+#include "bytecode.h"
+
+using namespace std;
+
+// 把字节码翻译成 x86-64 机器码
+// 生成的函数是 int64_t f(const int64_t* vars)，按 System V 调用约定 vars 在 rdi 中。
+// 栈顶放在 rax 里，下面的各层放在机器栈上，二元运算从机器栈弹出左操作数到 rcx。
+// 代码先写进可读写的内存，写完改成只读可执行，不同时可写可执行。
+// 不是 x86-64 或者申请不到可执行内存时退回到 interpret，调用方式不变。
+
+class native_expr {
+	typedef int64_t (*entry)(const int64_t*);
+
+	program prog;			// 退回解释执行时使用
+	entry fn;
+	void* mem;
+	size_t mem_size;
+	size_t length;			// 机器码的字节数
+
+	void release() {
+#ifdef JIT_X86_64
+		if ( mem ) munmap(mem, mem_size);
+#endif
+		fn = nullptr, mem = nullptr, mem_size = length = 0;
+	}
+
+#ifdef JIT_X86_64
+	// 机器码缓冲
+	struct emitter {
+		vector<uint8_t> code;
+
+		void bytes(initializer_list<uint8_t> b) { code.insert(code.end(), b); }
+		void u32(uint32_t v) { code.insert(code.end(), (uint8_t*)&v, (uint8_t*)&v + 4); }
+		void u64(uint64_t v) { code.insert(code.end(), (uint8_t*)&v, (uint8_t*)&v + 8); }
+		// 短跳转的偏移留空，返回它的位置
+		size_t jump(uint8_t op) {
+			bytes({op, 0});
+			return code.size() - 1;
+		}
+		void land(size_t at) { code[at] = uint8_t(code.size() - at - 1); }
+	};
+
+	static void emit(emitter& e, const program& prog) {
+		bool has_top = false;		// rax 中是否有值
+		for ( const instr& in : prog.code ) {
+			switch ( in.op ) {
+			case op_const:
+				if ( has_top ) e.bytes({0x50});					// push rax
+				e.bytes({0x48, 0xB8}), e.u64(prog.consts[in.arg]);	// mov rax, imm64
+				has_top = true;
+				break;
+			case op_load:
+				if ( has_top ) e.bytes({0x50});
+				e.bytes({0x48, 0x8B, 0x87}), e.u32(in.arg * 8);	// mov rax, [rdi + disp32]
+				has_top = true;
+				break;
+			default:
+				e.bytes({0x59});									// pop rcx，rcx 是左操作数
+				if ( in.op == op_add ) e.bytes({0x48, 0x01, 0xC8});	// add rax, rcx
+				else if ( in.op == op_sub ) {
+					e.bytes({0x48, 0x29, 0xC1});					// sub rcx, rax
+					e.bytes({0x48, 0x89, 0xC8});					// mov rax, rcx
+				}
+				else if ( in.op == op_mul ) e.bytes({0x48, 0x0F, 0xAF, 0xC1});	// imul rax, rcx
+				else {
+					// 与 eval_div 相同：除数为 0 得 0，除数为 -1 取负，避免 idiv 的异常
+					e.bytes({0x49, 0x89, 0xC0});					// mov r8, rax
+					e.bytes({0x4D, 0x85, 0xC0});					// test r8, r8
+					size_t zero = e.jump(0x74);						// jz zero
+					e.bytes({0x49, 0x83, 0xF8, 0xFF});				// cmp r8, -1
+					size_t neg = e.jump(0x74);						// je neg
+					e.bytes({0x48, 0x89, 0xC8});					// mov rax, rcx
+					e.bytes({0x48, 0x99});							// cqo
+					e.bytes({0x49, 0xF7, 0xF8});					// idiv r8
+					size_t done1 = e.jump(0xEB);					// jmp done
+					e.land(zero);
+					e.bytes({0x31, 0xC0});							// xor eax, eax
+					size_t done2 = e.jump(0xEB);					// jmp done
+					e.land(neg);
+					e.bytes({0x48, 0x89, 0xC8});					// mov rax, rcx
+					e.bytes({0x48, 0xF7, 0xD8});					// neg rax
+					e.land(done1);
+					e.land(done2);
+				}
+				break;
+			}
+		}
+		if ( !has_top ) e.bytes({0x31, 0xC0});
+		e.bytes({0xC3});											// ret
+	}
+#endif
+
+public:
+	native_expr() : fn(nullptr), mem(nullptr), mem_size(0), length(0) {}
+	explicit native_expr(const program& p) : native_expr() { compile(p); }
+	~native_expr() { release(); }
+	native_expr(const native_expr&) = delete;
+	native_expr& operator = (const native_expr&) = delete;
+
+	// 生成机器码，返回是否得到了本机代码
+	bool compile(const program& p) {
+		release();
+		prog = p;
+#ifdef JIT_X86_64
+		emitter e;
+		emit(e, prog);
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t size = (e.code.size() + page - 1) / page * page;
+		void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if ( m == MAP_FAILED ) return false;
+		memcpy(m, e.code.data(), e.code.size());
+		if ( mprotect(m, size, PROT_READ | PROT_EXEC) != 0 ) {
+			munmap(m, size);
+			return false;
+		}
+		mem = m, mem_size = size, length = e.code.size();
+		fn = (entry)m;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	bool native() const { return fn != nullptr; }
+	size_t code_size() const { return length; }
+
+	int64_t operator () (const int64_t* vars) const {
+		return fn ? fn(vars) : interpret(prog, vars);
+	}
+};
+
+#endif
@@ -0,0 +1,478 @@
+#ifndef LALR_H
+#define LALR_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../lab1/symbol_table.h"
+
+// LALR(1) 分析表的生成和表驱动的分析
+// 先求 LR(0) 项目集族，再用传播法求每个核心项目的向前看符号：
+// 对每个核心项目以一个占位符号求 LR(1) 闭包，得到自发生成的符号和传播关系，反复传播到不再变化。
+// 移进/规约冲突取移进，规约/规约冲突取靠前的产生式，都记为冲突，由调用方和文法中预期的个数比较。
+//
+// 动作表和转移表都用行位移（梳状）压缩：每行一个起点 base，各行的非空项错开叠放在同一个数组里，
+// 每个格子记下它属于哪一行，查一项是一次加法和一次读。
+// 每个状态出现最多的规约作为默认动作不占格子，转移表按非终结符分行，最常见的目标状态作为默认值。
+// 用了默认规约之后出错会推迟几次规约才发现，但不会移进错误的符号。
+// 分析时只有一个状态栈，每个输入符号移进一次，总时间和输入长度成正比。
+
+class lalr_table {
+public:
+	struct production {
+		uint32_t left;
+		std::vector<uint32_t> right;
+	};
+
+	struct grammar {
+		std::vector<production> rules;		// 第一个产生式的左部是开始符号
+		int expect = 0;						// 预期的冲突个数
+	};
+
+	struct conflict {
+		int state;
+		uint32_t sym;			// 向前看符号
+		int kept, dropped;		// 动作的编码
+	};
+
+	struct statistics {
+		size_t states, terminals, nonterminals, productions;
+		size_t action_cells, goto_cells;	// 压缩后的格子数
+		size_t bytes;						// 分析时用到的全部表的字节数
+	};
+
+private:
+	// 行位移压缩的稀疏矩阵
+	class comb {
+		struct cell {
+			int32_t row;		// 所属的行，空格子为 -1
+			int32_t value;
+		};
+		std::vector<int32_t> base;
+		std::vector<cell> cells;
+
+	public:
+		typedef std::vector<std::pair<int, int32_t>> row_type;	// (列, 值)
+
+		// 从最满的行开始，每行放在第一个放得下的位置
+		void pack(const std::vector<row_type>& rows) {
+			base.assign(rows.size(), 0);
+			cells.clear();
+			std::vector<int> order(rows.size());
+			for ( size_t r = 0; r < rows.size(); ++r ) order[r] = r;
+			std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return rows[a].size() > rows[b].size(); });
+			for ( int r : order ) {
+				const row_type& row = rows[r];
+				if ( row.empty() ) continue;
+				size_t b = 0;
+				for ( ; ; ++b ) {
+					bool fits = true;
+					for ( auto& e : row )
+						if ( b + e.first < cells.size() && cells[b + e.first].row >= 0 ) {
+							fits = false;
+							break;
+						}
+					if ( fits ) break;
+				}
+				base[r] = b;
+				for ( auto& e : row ) {
+					if ( b + e.first >= cells.size() ) cells.resize(b + e.first + 1, {-1, 0});
+					cells[b + e.first] = {r, e.second};
+				}
+			}
+		}
+
+		int32_t get(int r, int c, int32_t fallback) const {
+			size_t k = size_t(base[r]) + c;
+			return k < cells.size() && cells[k].row == r ? cells[k].value : fallback;
+		}
+
+		size_t size() const { return cells.size(); }
+		size_t bytes() const { return base.size() * sizeof(int32_t) + cells.size() * sizeof(cell); }
+	};
+
+	// 文法符号编码：终结符 0..T-1，0 是 #；非终结符 T..T+N-1
+	std::vector<int> code;				// 符号编号到编码，不在文法中时为 -1
+	size_t T, N;
+	std::vector<production> rules;		// 第 0 个是拓广的 S' -> S
+	std::vector<uint16_t> rule_left;	// 左部的非终结符下标
+	std::vector<uint16_t> rule_len;
+
+	comb actions, gotos;
+	std::vector<int32_t> default_action;
+	std::vector<int32_t> default_goto;
+	std::vector<conflict> conflicts;
+	size_t nstates;
+
+	int encode(uint32_t sym) const { return sym < code.size() ? code[sym] : -1; }
+
+public:
+	lalr_table() : T(0), N(0), nstates(0) {}
+
+	// 动作的编码：0 出错，s + 1 移进到状态 s，-(p + 1) 用产生式 p 规约，用产生式 0 规约就是接受
+	static int32_t shift_to(int s) { return s + 1; }
+	static int32_t reduce_by(int p) { return -(p + 1); }
+
+	// 由文法生成分析表，end 是输入结尾的界符 #
+	void build(const grammar& g, uint32_t end);
+
+	const std::vector<conflict>& conflict_list() const { return conflicts; }
+	const production& rule(int p) const { return rules[p]; }
+	statistics stats() const;
+
+	// 符号对应的终结符下标，不是终结符时为 -1
+	int terminal(uint32_t sym) const {
+		int c = encode(sym);
+		return c >= 0 && size_t(c) < T ? c : -1;
+	}
+
+	int32_t action(int state, int term) const { return actions.get(state, term, default_action[state]); }
+	int go(int state, int nt) const { return gotos.get(nt, state, default_goto[nt]); }
+
+	// 分析一串终结符下标，不含结尾的 #，每次规约调用 on_reduce(产生式)
+	// 出错时返回 false，where 是出错的输入位置，在输入结尾出错时等于 n
+	template<class F>
+	bool parse(const uint16_t* input, size_t n, std::vector<uint32_t>& stack, size_t& where, F&& on_reduce) const {
+		stack.clear();
+		stack.push_back(0);
+		size_t p = 0;
+		for ( ; ; ) {
+			int32_t a = action(stack.back(), p < n ? input[p] : 0);
+			if ( a > 0 ) {
+				stack.push_back(a - 1);
+				++p;
+			}
+			else if ( a < 0 ) {
+				int r = -a - 1;
+				if ( r == 0 ) return true;
+				on_reduce(r);
+				stack.resize(stack.size() - rule_len[r]);
+				stack.push_back(go(stack.back(), rule_left[r]));
+			}
+			else {
+				where = p;
+				return false;
+			}
+		}
+	}
+};
+
+inline void lalr_table::build(const grammar& g, uint32_t end) {
+	// 符号编码
+	uint32_t max_sym = end;
+	for ( const production& p : g.rules ) {
+		max_sym = std::max(max_sym, p.left);
+		for ( uint32_t s : p.right ) max_sym = std::max(max_sym, s);
+	}
+	code.assign(max_sym + 1, -1);
+	std::vector<uint32_t> nts, terms = {end};
+	for ( const production& p : g.rules )
+		if ( code[p.left] == -1 ) code[p.left] = -2, nts.push_back(p.left);
+	code[end] = 0;
+	for ( const production& p : g.rules )
+		for ( uint32_t s : p.right )
+			if ( code[s] == -1 ) code[s] = terms.size(), terms.push_back(s);
+	T = terms.size();
+	N = nts.size() + 1;				// 最后一个是拓广的开始符号
+	for ( size_t i = 0; i < nts.size(); ++i ) code[nts[i]] = T + i;
+
+	rules.clear();
+	rules.push_back({symbol_table::none, {g.rules.empty() ? end : g.rules[0].left}});
+	rules.insert(rules.end(), g.rules.begin(), g.rules.end());
+	size_t P = rules.size();
+	std::vector<std::vector<int>> rhs(P);		// 右部的编码
+	rule_left.assign(P, 0), rule_len.assign(P, 0);
+	rule_left[0] = N - 1;
+	for ( size_t p = 0; p < P; ++p ) {
+		if ( p > 0 ) rule_left[p] = code[rules[p].left] - T;
+		rule_len[p] = rules[p].right.size();
+		for ( uint32_t s : rules[p].right ) rhs[p].push_back(code[s]);
+	}
+	std::vector<std::vector<int>> by_left(N);
+	for ( size_t p = 0; p < P; ++p ) by_left[rule_left[p]].push_back(p);
+
+	// 项目编号：产生式 p 点在 d 处的项目是 item_base[p] + d
+	std::vector<uint32_t> item_base(P), item_rule, item_dot;
+	for ( size_t p = 0; p < P; ++p ) {
+		item_base[p] = item_rule.size();
+		for ( size_t d = 0; d <= rhs[p].size(); ++d ) item_rule.push_back(p), item_dot.push_back(d);
+	}
+	auto next_code = [&](uint32_t item) {		// 点后面的符号，点在最后时为 -1
+		const std::vector<int>& r = rhs[item_rule[item]];
+		return item_dot[item] < r.size() ? r[item_dot[item]] : -1;
+	};
+
+	// 向前看符号集合是位图，多出的一位是求传播关系时的占位符号
+	size_t W = (T + 1 + 63) / 64;
+	typedef std::vector<uint64_t> bits;
+	auto has = [](const bits& b, size_t i) { return b[i >> 6] >> (i & 63) & 1; };
+	auto set_bit = [](bits& b, size_t i) { b[i >> 6] |= uint64_t(1) << (i & 63); };
+	auto merge = [&](bits& to, const bits& from) {
+		bool changed = false;
+		for ( size_t w = 0; w < W; ++w )
+			if ( from[w] & ~to[w] ) to[w] |= from[w], changed = true;
+		return changed;
+	};
+
+	// 可空和 FIRST 集
+	std::vector<char> nullable(N);
+	std::vector<bits> first(N, bits(W));
+	for ( bool changed = true; changed; ) {
+		changed = false;
+		for ( size_t p = 0; p < P; ++p ) {
+			int A = rule_left[p];
+			bool all = true;
+			for ( int c : rhs[p] ) {
+				if ( size_t(c) < T ) {
+					if ( !has(first[A], c) ) set_bit(first[A], c), changed = true;
+					all = false;
+					break;
+				}
+				changed |= merge(first[A], first[c - T]);
+				if ( !nullable[c - T] ) {
+					all = false;
+					break;
+				}
+			}
+			if ( all && !nullable[A] ) nullable[A] = 1, changed = true;
+		}
+	}
+
+	// LR(0) 项目集族，状态由核心项目确定
+	std::vector<std::vector<uint32_t>> kernels;
+	std::vector<std::vector<std::pair<int, int>>> edges;	// (符号编码, 目标状态)
+	std::map<std::vector<uint32_t>, int> state_of;
+	std::vector<int> mark(N, -1);
+	auto closure0 = [&](const std::vector<uint32_t>& kernel, int stamp) {
+		std::vector<uint32_t> items = kernel;
+		for ( size_t i = 0; i < items.size(); ++i ) {
+			int c = next_code(items[i]);
+			if ( c < int(T) || mark[c - T] == stamp ) continue;
+			mark[c - T] = stamp;
+			for ( int p : by_left[c - T] ) items.push_back(item_base[p]);
+		}
+		return items;
+	};
+	kernels.push_back({item_base[0]});
+	state_of[kernels[0]] = 0;
+	for ( size_t s = 0; s < kernels.size(); ++s ) {
+		std::vector<uint32_t> items = closure0(kernels[s], s);
+		std::map<int, std::vector<uint32_t>> moved;
+		for ( uint32_t it : items ) {
+			int c = next_code(it);
+			if ( c >= 0 ) moved[c].push_back(it + 1);
+		}
+		std::vector<std::pair<int, int>> out;
+		for ( auto& m : moved ) {
+			std::sort(m.second.begin(), m.second.end());
+			auto ins = state_of.emplace(m.second, kernels.size());
+			if ( ins.second ) kernels.push_back(m.second);
+			out.emplace_back(m.first, ins.first->second);
+		}
+		edges.push_back(std::move(out));
+	}
+	nstates = kernels.size();
+	auto target = [&](int s, int c) {
+		for ( auto& e : edges[s] )
+			if ( e.first == c ) return e.second;
+		return -1;
+	};
+
+	// LR(1) 闭包，items 是 (项目, 向前看符号)，就地补全
+	std::vector<int> pos(item_rule.size(), -1);
+	auto closure1 = [&](std::vector<std::pair<uint32_t, bits>>& items) {
+		for ( size_t i = 0; i < items.size(); ++i ) pos[items[i].first] = i;
+		std::vector<size_t> work;
+		for ( size_t i = 0; i < items.size(); ++i ) work.push_back(i);
+		while ( !work.empty() ) {
+			size_t i = work.back();
+			work.pop_back();
+			uint32_t it = items[i].first;
+			int c = next_code(it);
+			if ( c < int(T) ) continue;
+			// FIRST(β L)
+			bits la(W);
+			const std::vector<int>& r = rhs[item_rule[it]];
+			bool rest_nullable = true;
+			for ( size_t d = item_dot[it] + 1; d < r.size(); ++d ) {
+				if ( size_t(r[d]) < T ) {
+					set_bit(la, r[d]);
+					rest_nullable = false;
+					break;
+				}
+				merge(la, first[r[d] - T]);
+				if ( !nullable[r[d] - T] ) {
+					rest_nullable = false;
+					break;
+				}
+			}
+			if ( rest_nullable ) merge(la, items[i].second);
+			for ( int p : by_left[c - T] ) {
+				uint32_t j = item_base[p];
+				if ( pos[j] < 0 ) {
+					pos[j] = items.size();
+					items.emplace_back(j, la);
+					work.push_back(pos[j]);
+				}
+				else if ( merge(items[pos[j]].second, la) )
+					work.push_back(pos[j]);
+			}
+		}
+		for ( auto& e : items ) pos[e.first] = -1;
+	};
+
+	// 传播法求核心项目的向前看符号
+	std::vector<std::vector<bits>> la(nstates);
+	for ( size_t s = 0; s < nstates; ++s ) la[s].assign(kernels[s].size(), bits(W));
+	set_bit(la[0][0], 0);
+	struct link { int s, k, t, j; };
+	std::vector<link> links;
+	for ( size_t s = 0; s < nstates; ++s )
+		for ( size_t k = 0; k < kernels[s].size(); ++k ) {
+			std::vector<std::pair<uint32_t, bits>> items;
+			items.emplace_back(kernels[s][k], bits(W));
+			set_bit(items[0].second, T);
+			closure1(items);
+			for ( auto& e : items ) {
+				int c = next_code(e.first);
+				if ( c < 0 ) continue;
+				int t = target(s, c);
+				const std::vector<uint32_t>& kt = kernels[t];
+				int j = std::lower_bound(kt.begin(), kt.end(), e.first + 1) - kt.begin();
+				bits spont = e.second;
+				if ( has(spont, T) ) {
+					links.push_back({int(s), int(k), t, j});
+					spont[T >> 6] &= ~(uint64_t(1) << (T & 63));
+				}
+				merge(la[t][j], spont);
+			}
+		}
+	for ( bool changed = true; changed; ) {
+		changed = false;
+		for ( const link& l : links ) changed |= merge(la[l.t][l.j], la[l.s][l.k]);
+	}
+
+	// 动作表
+	conflicts.clear();
+	std::vector<comb::row_type> action_rows(nstates);
+	default_action.assign(nstates, 0);
+	std::vector<int32_t> row(T);
+	for ( size_t s = 0; s < nstates; ++s ) {
+		std::fill(row.begin(), row.end(), 0);
+		for ( auto& e : edges[s] )
+			if ( size_t(e.first) < T ) row[e.first] = shift_to(e.second);
+		std::vector<std::pair<uint32_t, bits>> items;
+		for ( size_t k = 0; k < kernels[s].size(); ++k ) items.emplace_back(kernels[s][k], la[s][k]);
+		closure1(items);
+		for ( auto& e : items ) {
+			if ( next_code(e.first) >= 0 ) continue;
+			int32_t r = reduce_by(item_rule[e.first]);
+			for ( size_t a = 0; a < T; ++a ) {
+				if ( !has(e.second, a) ) continue;
+				int32_t& cur = row[a];
+				if ( cur == 0 ) cur = r;
+				else if ( cur > 0 || cur > r ) conflicts.push_back({int(s), terms[a], cur, r});
+				else conflicts.push_back({int(s), terms[a], r, cur}), cur = r;
+			}
+		}
+		// 默认规约，不用接受动作
+		std::map<int32_t, int> count;
+		for ( int32_t a : row )
+			if ( a < 0 && a != reduce_by(0) ) ++count[a];
+		int best = 0;
+		for ( auto& c : count )
+			if ( c.second > best ) best = c.second, default_action[s] = c.first;
+		for ( size_t a = 0; a < T; ++a )
+			if ( row[a] != 0 && row[a] != default_action[s] ) action_rows[s].emplace_back(a, row[a]);
+	}
+	actions.pack(action_rows);
+
+	// 转移表，按非终结符分行
+	std::vector<comb::row_type> goto_rows(N);
+	std::vector<std::map<int, int>> goto_count(N);
+	default_goto.assign(N, 0);
+	for ( size_t s = 0; s < nstates; ++s )
+		for ( auto& e : edges[s] )
+			if ( size_t(e.first) >= T ) ++goto_count[e.first - T][e.second];
+	for ( size_t A = 0; A < N; ++A ) {
+		int best = 0;
+		for ( auto& c : goto_count[A] )
+			if ( c.second > best ) best = c.second, default_goto[A] = c.first;
+	}
+	for ( size_t s = 0; s < nstates; ++s )
+		for ( auto& e : edges[s] )
+			if ( size_t(e.first) >= T && e.second != default_goto[e.first - T] )
+				goto_rows[e.first - T].emplace_back(s, e.second);
+	gotos.pack(goto_rows);
+}
+
+inline lalr_table::statistics lalr_table::stats() const {
+	statistics st;
+	st.states = nstates;
+	st.terminals = T;
+	st.nonterminals = N - 1;
+	st.productions = rules.size() - 1;
+	st.action_cells = actions.size();
+	st.goto_cells = gotos.size();
+	st.bytes = actions.bytes() + gotos.bytes() + (default_action.size() + default_goto.size()) * sizeof(int32_t)
+			 + (rule_left.size() + rule_len.size()) * sizeof(uint16_t);
+	return st;
+}
+
+// 读文法文件，符号登记到 symbols 中，出错时返回 false，error 是原因
+// 每行一个产生式 A -> x y z，右部用 | 分开多个候选，以 | 开头的行接着上一个左部，
+// 空的候选是 ε。符号之间用空白分开，// 之后是注释。%expect N 给出预期的冲突个数。
+inline bool read_grammar(std::istream& is, symbol_table& symbols, lalr_table::grammar& g, std::string& error) {
+	g.rules.clear();
+	g.expect = 0;
+	std::string line;
+	uint32_t left = symbol_table::none;
+	for ( int row = 1; std::getline(is, line); ++row ) {
+		size_t comment = line.find("//");
+		if ( comment != std::string::npos ) line.resize(comment);
+		std::istringstream ls(line);
+		std::vector<std::string> words;
+		for ( std::string w; ls >> w; ) words.push_back(w);
+		if ( words.empty() ) continue;
+		if ( words[0] == "%expect" ) {
+			bool ok = words.size() == 2;
+			if ( ok ) {
+				const std::string& n = words[1];
+				auto res = std::from_chars(n.data(), n.data() + n.size(), g.expect);
+				ok = res.ec == std::errc() && res.ptr == n.data() + n.size() && g.expect >= 0;
+			}
+			if ( !ok ) {
+				error = "line " + std::to_string(row) + ": %expect needs a number";
+				return false;
+			}
+			continue;
+		}
+		size_t i = 0;
+		if ( words.size() >= 2 && words[1] == "->" ) {
+			left = symbols.intern(words[0]);
+			i = 2;
+		}
+		else if ( words[0] == "|" && left != symbol_table::none ) i = 1;
+		else {
+			error = "line " + std::to_string(row) + ": expected A -> ...";
+			return false;
+		}
+		g.rules.push_back({left, {}});
+		for ( ; i < words.size(); ++i ) {
+			if ( words[i] == "|" ) g.rules.push_back({left, {}});
+			else g.rules.back().right.push_back(symbols.intern(words[i]));
+		}
+	}
+	if ( g.rules.empty() ) {
+		error = "no productions";
+		return false;
+	}
+	return true;
+}
+
+#endif
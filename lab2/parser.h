@@ -0,0 +1,620 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string_view>
+#include "../lab1/token.h"
+#include "../lab1/token_format.h"
+#include "../lab1/token_table.h"
+#include "spsc_ring.h"
+#include "precedence.h"
+#include "lalr.h"
+#include "trace.h"
+#include "ast.h"
+
+using namespace std;
+
+
+// 算符优先文法，在 grammer_init 中声明，优先关系表由它生成
+// E->E+T|E-T|T
+// T->T*F|T/F|F
+// F->(E)|i
+//
+// 生成的算符优先表
+//----------------------------------
+//     +   -   *   /   (   )   i   #
+// +   >   >   <   <   <   >   <   >
+// -   >   >   <   <   <   >   <   >
+// *   >   >   >   >   <   >   <   >
+// /   >   >   >   >   <   >   <   >
+// (   <   <   <   <   <   =   <   ?
+// )   >   >   >   >   ?   >   ?   >
+// i   >   >   >   >   ?   >   ?   >
+// #   <   <   <   <   <   ?   <   =
+//----------------------------------
+
+
+// 符号表：算符、非终结符和输入的单词都换成编号，分析过程中只比较整数
+inline symbol_table symbols;
+inline uint32_t NT[3];				// E T F
+inline uint32_t lparen_sym, rparen_sym, i_sym, end_sym;		// ( ) i #
+inline uint32_t assign_sym;			// "="
+
+inline precedence_table prec;
+
+// 分析过程的输出，默认逐步输出到标准输出
+inline parse_trace trace;
+
+// 文法中的终结符，包括 i 和 #
+inline bool is_operator(uint32_t sym) {
+	return prec.is_terminal(sym);
+}
+
+
+inline bool is_NT(uint32_t sym) {
+	return prec.is_nonterminal(sym);
+}
+
+// 产生式中的符号：非终结符和算符是它本身，其余的单词都是 i
+inline uint32_t rule_symbol(uint32_t sym) {
+	return is_NT(sym) || is_operator(sym) ? sym : i_sym;
+}
+
+// 句柄的终结符骨架：算符优先分析不区分非终结符，规约出的 E、T、F 都当作同一个非终结符
+inline uint32_t skeleton_symbol(uint32_t sym) {
+	return is_NT(sym) ? NT[0] : rule_symbol(sym);
+}
+
+// 产生式右部的终结符骨架组成的前缀树，边上是符号编号，匹配一个句柄只走一遍
+class rule_trie {
+	struct node {
+		vector<pair<uint32_t, uint32_t>> next;		// (符号, 子节点)
+		uint32_t left = symbol_table::none;			// 在这里结束的产生式的左部
+	};
+	vector<node> nodes = vector<node>(1);
+
+	uint32_t child(uint32_t k, uint32_t sym) const {
+		for(auto& e : nodes[k].next)
+			if(e.first == sym)
+				return e.second;
+		return 0;
+	}
+
+public:
+	void insert(const vector<uint32_t>& right, uint32_t left) {
+		uint32_t k = 0;
+		for(uint32_t sym : right) {
+			uint32_t c = child(k, skeleton_symbol(sym));
+			if(c == 0) {
+				c = nodes.size();
+				nodes[k].next.emplace_back(skeleton_symbol(sym), c);
+				nodes.emplace_back();
+			}
+			k = c;
+		}
+		nodes[k].left = left;
+	}
+
+	// 整个 [first, last) 和某个产生式的右部骨架相同时返回它的左部，否则返回 none
+	template<class It>
+	uint32_t match(It first, It last) const {
+		uint32_t k = 0;
+		for(; first != last; ++first)
+			if((k = child(k, skeleton_symbol(*first))) == 0)
+				return symbol_table::none;
+		return nodes[k].left;
+	}
+};
+
+inline rule_trie grammer_left;
+
+// 产生式右部的每个字符是一个符号
+inline vector<uint32_t> rule_symbols(string_view right) {
+	vector<uint32_t> res;
+	for(char ch : right)
+		res.emplace_back(symbols.intern(string_view(&ch, 1)));
+	return res;
+}
+
+inline void add_rule(string_view right, string_view left) {
+	grammer_left.insert(rule_symbols(right), symbols.intern(left));
+}
+
+inline vector<precedence_table::production> grammer;
+
+inline void add_production(string_view left, string_view right) {
+	grammer.push_back({symbols.intern(left), rule_symbols(right)});
+}
+
+inline const char* relation_name(int r) {
+	return r == prec_less ? "<" : r == prec_equal ? "=" : r == prec_greater ? ">" : "?";
+}
+
+inline void grammer_init() {
+	NT[0] = symbols.intern("E");
+	NT[1] = symbols.intern("T");
+	NT[2] = symbols.intern("F");
+	lparen_sym = symbols.intern("(");
+	rparen_sym = symbols.intern(")");
+	i_sym = symbols.intern("i");
+	end_sym = symbols.intern("#");
+	assign_sym = symbols.intern("=");
+	trace.set_symbols(symbols);
+
+	// 算符优先文法
+	grammer.clear();
+	add_production("E", "E+T");
+	add_production("E", "E-T");
+	add_production("E", "T");
+	add_production("T", "T*F");
+	add_production("T", "T/F");
+	add_production("T", "F");
+	add_production("F", "(E)");
+	add_production("F", "i");
+	prec.build(grammer, NT[0], end_sym);
+	for(auto& c : prec.conflict_list())
+		cerr << "precedence conflict: " << symbols.name(c.a) << " " << relation_name(c.old_rel) << " "
+			 << symbols.name(c.b) << " and " << symbols.name(c.a) << " " << relation_name(c.new_rel) << " "
+			 << symbols.name(c.b) << cr;
+	if(!prec.has_functions())
+		cerr << "no precedence functions, using the relation table" << cr;
+
+	// 最左素短语：文法中含终结符的右部，加上整个输入 #E#
+	// 只有一个非终结符的右部（E->T、T->F）不含终结符，不会成为素短语
+	for(auto& p : grammer)
+		if(p.right.size() > 1 || !is_NT(p.right[0]))
+			grammer_left.insert(p.right, p.left);
+	add_rule("#E#", "E");
+}
+
+// 终结符编号，不在文法中的单词都当作 i
+inline int id(uint32_t sym) {
+	int k = prec.index(sym);
+	return k >= 0 ? k : prec.index(i_sym);
+}
+
+// 把一串符号的名字拼起来
+template<class It>
+inline string names(It first, It last) {
+	string str;
+	for(; first != last; ++first)
+		str += symbols.name(*first);
+	return str;
+}
+
+// 输入 token 流：文本格式、二进制格式（按文件头自动识别）、同一进程中词法分析线程的队列，或者列式 token 表
+// token 的值指向输入，在读下一个 token 之前有效；读出的 token 都登记到 symbols 中。
+// 符号表不是线程安全的，词法分析线程不登记符号，由这里统一登记。
+class token_source {
+	bool binary;
+	ifstream ifs;
+	string line;			// 文本格式的当前行
+	token_file file;
+	uint32_t next;
+	spsc_ring<token>* ring;
+	const token_table* table;
+	token_table::cursor cur;
+
+public:
+	token_source() : binary(false), next(0), ring(nullptr), table(nullptr), cur(nullptr) {}
+
+	void attach(spsc_ring<token>* _ring) { ring = _ring, table = nullptr; }
+	void attach(const token_table* _table) { table = _table, ring = nullptr, cur = _table->read(); }
+
+	bool open(const string& path) {
+		ring = nullptr, table = nullptr;
+		ifs.close();
+		ifs.clear();
+		binary = is_token_file(path);
+		if ( binary ) {
+			next = 0;
+			return file.open(path);
+		}
+		ifs.open(path, ios::in);
+		return bool(ifs);
+	}
+
+	bool read(token& tk) {
+		if ( !next_token(tk) ) return false;
+		if ( tk.sym == symbol_table::none ) tk.sym = symbols.intern(tk.value);
+		return true;
+	}
+
+private:
+	bool next_token(token& tk) {
+		if ( ring ) return ring->pop(tk);
+		if ( table ) return cur.next(tk);
+		if ( binary ) {
+			if ( next >= file.tokens() ) return false;
+			const token_record& r = file[next];
+			tk = token(r.row, r.col, token_type(r.type), file.value(next));
+			++next;
+			return true;
+		}
+		uint32_t row, col;
+		uint8_t type;
+		string_view value;
+		if ( !getline(ifs, line) || !parse_token_line(line, row, col, type, value) ) return false;
+		tk = token(row, col, token_type(type), value);
+		return true;
+	}
+};
+
+inline token_source src;
+
+// 分析栈，另外记下其中每个终结符的位置，栈顶终结符就是 terms.back()
+// nodes 是每个栈中符号对应的语法树结点，运算对象移进时就建好叶子，算符和括号没有结点
+// first 是每个栈中符号覆盖的第一个输入单词的下标，规约时由它得到结点覆盖的单词个数
+struct parse_stack {
+	vector<uint32_t> syms;
+	vector<size_t> terms;
+	vector<uint32_t> nodes;
+	vector<uint32_t> first;
+	vector<uint32_t> rule;		// 输出规约式用
+
+	void clear() {
+		syms.clear();
+		terms.clear();
+		nodes.clear();
+		first.clear();
+	}
+
+	void push(uint32_t sym, uint32_t node = ast_null, uint32_t from = 0) {
+		if(!is_NT(sym))
+			terms.emplace_back(syms.size());
+		syms.emplace_back(sym);
+		nodes.emplace_back(node);
+		first.emplace_back(from);
+	}
+
+	uint32_t top_terminal() const {
+		return terms.empty() ? symbol_table::none : syms[terms.back()];
+	}
+
+	// 从栈顶终结符沿着 = 关系往下走，遇到 < 时停止，
+	// 句柄从这个 < 左边的终结符之上开始，只经过句柄里的终结符
+	size_t handle() const {
+		if(terms.empty())
+			return 0;
+		size_t k = terms.size() - 1;
+		while(k > 0 && prec.relation(id(syms[terms[k - 1]]), id(syms[terms[k]])) == prec_equal)
+			--k;
+		return k > 0 ? terms[k - 1] + 1 : 0;
+	}
+
+	// 把 start 以上的句柄换成 left
+	void reduce(size_t start, uint32_t left, uint32_t node) {
+		uint32_t from = first[start];
+		syms.resize(start);
+		nodes.resize(start);
+		first.resize(start);
+		while(!terms.empty() && terms.back() >= start)
+			terms.pop_back();
+		push(left, node, from);
+	}
+};
+
+struct parse_workspace {
+	vector<uint32_t> input;
+	vector<uint8_t> numeric;	// 输入的单词是不是数
+	parse_stack stack;
+	ast_pool ast;
+	uint32_t root = ast_null;	// 最近一个表达式的语法树，分析失败时为 ast_null
+	uint64_t reductions = 0;	// 累计的规约次数，两种分析都算
+
+	// 整个程序的 LALR(1) 分析
+	vector<uint16_t> terms;		// 每个 token 的终结符下标
+	vector<token> tokens;		// 出错时报告位置用，值换成了符号表中的名字
+	vector<uint32_t> states;
+};
+
+inline parse_workspace work;
+
+// 由句柄建立语法树结点：单个运算对象就是它的叶子，两个子树夹一个算符是二元运算，
+// 括号和 # 只是把里面的子树传上去
+inline uint32_t build_node(parse_workspace& w, size_t start) {
+	const parse_stack& stack = w.stack;
+	uint32_t child[2], op = symbol_table::none;
+	int children = 0, ops = 0;
+	for(size_t i = start; i < stack.syms.size(); ++i) {
+		uint32_t sym = stack.syms[i];
+		if(stack.nodes[i] != ast_null) {
+			if(children == 2) return ast_null;
+			child[children++] = stack.nodes[i];
+		}
+		else if(sym != lparen_sym && sym != rparen_sym && sym != end_sym) {
+			op = sym;
+			++ops;
+		}
+	}
+	if(children == 2 && ops == 1)
+		return w.ast.binary(op, symbols.name(op)[0], child[0], child[1]);
+	if(children == 1 && ops == 0)
+		return child[0];
+	return ast_null;
+}
+
+// 输入中第 p 个运算对象的叶子
+inline uint32_t leaf(parse_workspace& w, size_t p) {
+	uint32_t sym = w.input[p];
+	int64_t value;
+	if(w.numeric[p] && parse_number(symbols.name(sym), value))
+		return w.ast.number(sym, value);
+	return w.ast.name(sym);
+}
+
+// 非终结符在 NT 中的下标
+inline uint8_t nt_index(uint32_t sym) {
+	for(uint8_t k = 0; k < 3; ++k)
+		if(NT[k] == sym)
+			return k;
+	return ast_no_nt;
+}
+
+// 找出句柄并规约，句柄不是任何产生式的右部时返回 false
+// 句柄覆盖第 first[start] 到第 p 个（不含）输入单词，结点的单词个数和外层括号由此得到
+inline bool reduce(parse_workspace& w, parse_trace& t, size_t p) {
+	parse_stack& stack = w.stack;
+	size_t start;
+	uint32_t left_t;
+	{
+		HOT_SCOPE(hp_handle);
+		start = stack.handle();
+		left_t = grammer_left.match(stack.syms.begin() + start, stack.syms.end());
+	}
+	if(left_t == symbol_table::none)
+		return false;
+	auto first = stack.syms.begin() + start, last = stack.syms.end();
+	vector<uint32_t>& rule = stack.rule;
+	rule.clear();
+	if(t.needs_rules())
+		for(auto it = first; it != last; ++it)
+			rule.emplace_back(rule_symbol(*it));
+	t.reduce(start, left_t, rule.data(), rule.size());
+	HOT_SCOPE(hp_reduce);
+	++w.reductions;
+
+	uint32_t node = build_node(w, start);
+	if(node != ast_null) {
+		uint32_t from = stack.first[start];
+		uint32_t to = uint32_t(min(p, w.input.size() - 1));
+		ast_node& n = w.ast[node];
+		if(n.width == 0)
+			n.lead = 0;
+		else
+			for(size_t i = start; i < stack.syms.size(); ++i)
+				if(stack.nodes[i] == node)
+					n.lead += stack.first[i] - from;
+		n.width = to - from;
+		if(stack.syms[start] != end_sym)
+			n.nt = nt_index(left_t);
+	}
+	stack.reduce(start, left_t, node);
+	return true;
+}
+
+// 移进第 p 个输入符号，运算对象同时建好叶子
+inline void shift(parse_workspace& w, size_t p) {
+	HOT_SCOPE(hp_shift);
+	uint32_t sym = w.input[p];
+	bool operand = !is_operator(sym) && !is_NT(sym);
+	HOT_DEPTH(w.stack.syms.size() + 1);
+	w.stack.push(sym, operand ? leaf(w, p) : ast_null, uint32_t(p));
+}
+
+// 分析 w.input 中的符号，最后一个是 #，每次规约只看句柄本身，整个表达式是线性时间
+// 结点加到 w.ast 中，不重置也不折叠常量，成功时返回语法树的根，失败时返回 ast_null
+inline uint32_t parse_input(parse_workspace& w, parse_trace& t) {
+	const vector<uint32_t>& input = w.input;
+	parse_stack& stack = w.stack;
+	stack.clear();
+	stack.push(end_sym);
+
+	for(size_t p = 0; p < input.size(); ) {
+		// 输出符号栈和输入串
+		t.row();
+
+		// 输出操作，以及可能的规约串
+		int relation = prec.relation(id(stack.top_terminal()), id(input[p]));
+		// 对应的优先关系 (a, b) = <
+		if(relation == prec_less) {
+			t.action(act_shift);
+			t.shift();
+			shift(w, p++);
+		}
+		// 对应的优先关系 (a, b) = >
+		else if(relation == prec_greater) {
+			t.action(act_reduce);
+			if(!reduce(w, t, p)) {
+				t.fail();
+				return ast_null;
+			}
+		}
+		// 对应的优先关系 (a, b) = =，移进之后立即规约
+		else if(relation == prec_equal) {
+			t.action(act_shift_reduce);
+			t.shift();
+			shift(w, p++);
+			if(!reduce(w, t, p)) {
+				t.fail();
+				return ast_null;
+			}
+		}
+		// 对应的优先关系 (a, b) = ?
+		else {
+			t.fail();
+			return ast_null;
+		}
+
+		t.end_row();
+	}
+
+	bool ok = stack.syms.size() == 1 && stack.syms[0] == NT[0];
+	t.finish(ok);
+	return ok ? stack.nodes[0] : ast_null;
+}
+
+// 输出语法错误的位置，tk 为空时是在输入结尾
+inline void syntax_error(const token* tk, string_view why = "") {
+	if(trace.get_level() == trace_none)
+		return;
+	if(!tk) {
+		trace.print("语法错误: 输入意外结束");
+		return;
+	}
+	trace.print("语法错误: " + to_string(tk->row) + " 行 " + to_string(tk->col) + " 列的 " + string(tk->value) + string(why));
+}
+
+// 从 src 读一个表达式并分析
+// 成功时语法树折叠常量后放在 work.root
+inline int parser() {
+	vector<uint32_t>& input = work.input;
+	input.clear();
+	work.numeric.clear();
+	work.ast.reset();
+	work.root = ast_null;
+
+	token tk;
+	bool bad = false;
+	while(src.read(tk)) {
+		if(tk.sym == lparen_sym || tk.sym == rparen_sym || tk.type == number || tk.type == operate || tk.type == identifier) {
+			input.emplace_back(tk.sym);
+			work.numeric.emplace_back(tk.type == number);
+		}
+		else {
+			bad = tk.type == invalid;	// 词法分析恢复模式留下的非法单词
+			break;
+		}
+	}
+	if(bad) {
+		syntax_error(&tk, "，是非法单词");
+		return -1;
+	}
+
+	trace.begin(input.data(), input.size(), end_sym);
+	input.emplace_back(end_sym);
+	work.numeric.emplace_back(0);
+	work.root = parse_input(work, trace);
+	if(work.root == ast_null)
+		return -1;
+	fold_constants(work.ast);
+	return 0;
+}
+
+// 语句语言的 LALR(1) 分析表，由 lalr_init 从文法文件生成
+inline lalr_table lalr;
+inline int class_term[invalid + 1];		// 按单词类别对应的终结符，-1 表示按单词本身
+
+// 产生式写成 A -> x y z
+inline string rule_string(const lalr_table::production& p) {
+	string str(symbols.name(p.left));
+	str += " ->";
+	for(uint32_t s : p.right) {
+		str += ' ';
+		str += symbols.name(s);
+	}
+	return str;
+}
+
+// 读文法文件并生成分析表，要在 grammer_init 之后调用
+// 冲突个数和文法中预期的不同时把冲突输出到 cerr
+inline bool lalr_init(const string& path) {
+	ifstream ifs(path);
+	lalr_table::grammar g;
+	string error;
+	if(!ifs || !read_grammar(ifs, symbols, g, error)) {
+		cerr << path << ": " << (ifs ? error : "cannot open") << cr;
+		return false;
+	}
+	lalr.build(g, end_sym);
+	// 文法中没有写出单词类别时，这一类单词也按本身匹配
+	const char* classes[] = {nullptr, nullptr, nullptr, "<id>", "<label>", "<str>", "<num>", nullptr};
+	for(int t = 0; t <= invalid; ++t)
+		class_term[t] = classes[t] ? lalr.terminal(symbols.intern(classes[t])) : -1;
+	auto& conflicts = lalr.conflict_list();
+	if(int(conflicts.size()) != g.expect) {
+		for(auto& c : conflicts)
+			cerr << "state " << c.state << " on " << symbols.name(c.sym) << ": "
+				 << (c.kept > 0 ? "shift/reduce" : "reduce/reduce") << " conflict, dropped "
+				 << rule_string(lalr.rule(-c.dropped - 1)) << cr;
+		cerr << conflicts.size() << " conflicts, expected " << g.expect << cr;
+	}
+	return true;
+}
+
+// 读入全部 token 并一遍分析整个程序，返回 0 成功，-1 出错
+// full 级别输出每一步规约用的产生式，summary 级别只输出结果
+inline int parse_program() {
+	HOT_SCOPE(hp_lalr);
+	vector<uint16_t>& terms = work.terms;
+	vector<token>& tokens = work.tokens;
+	terms.clear();
+	tokens.clear();
+	token tk;
+	while(src.read(tk)) {
+		int t = tk.type == invalid ? -1 : class_term[tk.type] == -1 ? lalr.terminal(tk.sym) : class_term[tk.type];
+		tk.value = symbols.name(tk.sym);
+		tokens.emplace_back(tk);
+		if(t < 0) {
+			syntax_error(&tokens.back(), tk.type == invalid ? "，是非法单词" : "，不是文法中的终结符");
+			return -1;
+		}
+		terms.emplace_back(t);
+	}
+
+	size_t where;
+	string str;
+	bool ok = lalr.parse(terms.data(), terms.size(), work.states, where, [&](int r) {
+		++work.reductions;
+		if(trace.get_level() != trace_full)
+			return;
+		str = rule_string(lalr.rule(r));
+		trace.print(str);
+	});
+	if(ok) {
+		if(trace.get_level() != trace_none)
+			trace.print("分析成功，" + to_string(terms.size()) + " 个单词");
+		return 0;
+	}
+	syntax_error(where < tokens.size() ? &tokens[where] : nullptr);
+	return -1;
+}
+
+// 分析表统计，写到 os
+inline void print_tables(ostream& os) {
+	lalr_table::statistics st = lalr.stats();
+	os << "lalr: " << st.states << " states, " << st.terminals << " terminals, " << st.nonterminals
+	   << " nonterminals, " << st.productions << " productions, " << st.action_cells << " action cells, "
+	   << st.goto_cells << " goto cells, " << st.bytes << " bytes" << cr;
+}
+
+// 符号表统计，写到 os
+inline void print_symbols(ostream& os) {
+	symbol_table::statistics st = symbols.stats();
+	os << "symbols: " << st.symbols << ", lookups: " << st.lookups << ", bytes: " << st.bytes
+	   << ", saved: " << st.saved << " bytes" << cr;
+}
+
+// 依次分析输入中每个赋值语句右侧的表达式，返回失败的个数
+// print_ast 时在每个成功的表达式之后输出折叠后的语法树
+inline int parse_assignments(bool print_ast = false) {
+	int failed = 0;
+	token tk;
+	string str;
+	while(src.read(tk)) {
+		if(tk.type == token_type::operate && tk.sym == assign_sym) {
+			int res = parser();
+			failed += res < 0;
+			if(print_ast && res == 0) {
+				str = "语法树: ";
+				ast_to_string(work.ast, work.root, symbols, str);
+				trace.print(str);
+			}
+		}
+	}
+	return failed;
+}
+
+#endif
@@ -0,0 +1,157 @@
+// 词法分析和算符优先分析在同一进程中流水线执行
+// 词法分析线程把 token 放进无锁队列，分析线程边读边规约，不经过磁盘
+// 用法: pipeline [源文件] [-o 分析输出] [--compare] [--trace=none|summary|full]
+//   --compare  另外按原来的两步流程（texer 写 token 文件，parser 再读回）
+//              和先分析成列式 token 表再读表的流程各跑一遍并对比
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <iterator>
+#include "../lab1/texer.h"
+#include "parser.h"
+#include "spsc_ring.h"
+
+using namespace std;
+typedef chrono::steady_clock timer;
+
+double seconds(timer::time_point a, timer::time_point b) {
+	return chrono::duration<double>(b - a).count();
+}
+
+struct run_result {
+	size_t tokens;
+	int failed;
+	double first;		// 分析线程拿到第一个 token 的时间
+	double total;
+};
+
+// 从 token 源读入并分析，记录拿到第一个 token 的时间
+int parse_from_source(timer::time_point start, double& first) {
+	int failed = 0;
+	bool got = false;
+	token tk;
+	while(src.read(tk)) {
+		if(!got) {
+			first = seconds(start, timer::now());
+			got = true;
+		}
+		if(tk.type == token_type::operate && tk.sym == assign_sym)
+			failed += parser() < 0;
+	}
+	return failed;
+}
+
+bool run_pipeline(const string& path, run_result& res) {
+	auto start = timer::now();
+	texer tx;
+	if(!tx.init(path)) return false;
+	tx.preprocess();
+
+	spsc_ring<token> ring(1 << 16, 256);
+	src.attach(&ring);
+	res.tokens = 0;
+	thread lexer([&]() {
+		for(const token& tk : tx) {
+			ring.push(tk);
+			++res.tokens;
+		}
+		ring.close();
+	});
+	res.failed = parse_from_source(start, res.first);
+	lexer.join();
+	res.total = seconds(start, timer::now());
+	return true;
+}
+
+// 原来的流程：先把全部 token 写成文本文件，再读回来分析
+bool run_files(const string& path, const string& token_path, run_result& res) {
+	auto start = timer::now();
+	{
+		texer tx;
+		if(!tx.init(path)) return false;
+		tx.preprocess();
+		ofstream ofs = ofstream(token_path, ios::out);
+		tx.get_tokens(ofs);
+	}
+	if(!src.open(token_path)) return false;
+	ifstream ifs = ifstream(token_path, ios::in);
+	res.tokens = count(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>(), cr);
+	res.failed = parse_from_source(start, res.first);
+	res.total = seconds(start, timer::now());
+	return true;
+}
+
+// 先把全部 token 放进列式表，再从表中读出分析
+bool run_table(const string& path, run_result& res, size_t& bytes) {
+	auto start = timer::now();
+	texer tx;
+	if(!tx.init(path)) return false;
+	tx.preprocess();
+	token_table table(symbols);
+	tx.get_tokens(table);
+	src.attach(&table);
+	res.tokens = table.size();
+	bytes = table.bytes();
+	res.failed = parse_from_source(start, res.first);
+	res.total = seconds(start, timer::now());
+	return true;
+}
+
+void report(const char* name, const run_result& res) {
+	cerr << name << ": " << res.tokens << " tokens, total " << res.total * 1000 << " ms, "
+		 << "first token after " << res.first * 1000 << " ms, "
+		 << res.tokens / res.total << " tokens/s, " << res.failed << " failed" << cr;
+}
+
+int main(int argc, char* argv [ ]) {
+	string path = "../lab1/source1.c", out_file;
+	bool compare = false;
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if(arg == "--compare") compare = true;
+		else if(arg == "-o" && i + 1 < argc) out_file = argv[++i];
+		else if(arg == "--trace=none") trace.set_level(trace_none);
+		else if(arg == "--trace=summary") trace.set_level(trace_summary);
+		else if(arg == "--trace=full") trace.set_level(trace_full);
+		else path = arg;
+	}
+
+	// 分析过程的输出
+	ofstream out;
+	streambuf* saved = cout.rdbuf();
+	if(!out_file.empty()) {
+		out.open(out_file, ios::out);
+		cout.rdbuf(out.rdbuf());
+	}
+	grammer_init();
+
+	run_result piped;
+	if(!run_pipeline(path, piped)) {
+		cerr << "Cannot open " << path << cr;
+		return 1;
+	}
+	report("pipeline", piped);
+	if(compare) {
+		run_result files;
+		if(!run_files(path, "pipeline_tokens.txt", files)) {
+			cerr << "Cannot run file-based flow" << cr;
+			return 1;
+		}
+		report("files   ", files);
+		cerr << "speedup: " << files.total / piped.total << "x" << cr;
+		run_result table;
+		size_t bytes;
+		if(!run_table(path, table, bytes)) {
+			cerr << "Cannot run table-based flow" << cr;
+			return 1;
+		}
+		report("table   ", table);
+		cerr << "token table: " << bytes << " bytes, " << double(bytes) / max<size_t>(table.tokens, 1) << " bytes/token" << cr;
+	}
+	print_symbols(cerr);
+	trace.flush();
+	cout.rdbuf(saved);
+	return piped.failed > 0;
+}
@@ -0,0 +1,208 @@
+#ifndef PRECEDENCE_H
+#define PRECEDENCE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// 由算符优先文法生成优先关系表和优先函数
+// 文法符号都是符号表中的编号，出现在产生式左部的是非终结符，其余是终结符。
+// 先求每个非终结符的 FIRSTVT / LASTVT，再按产生式填出终结符之间的关系，
+// 同一对终结符得到两种关系时记为冲突。关系图无环时再压缩成 Floyd 优先函数 f / g：
+// a < b 当且仅当 f(a) < g(b)，另外两种关系同理，查一次关系只读两个数。
+// 优先函数分不出没有关系的空白项，空白项另用一张位图记录。
+
+const int prec_less = -1, prec_equal = 0, prec_greater = 1, prec_none = 2;
+
+class precedence_table {
+public:
+	struct production {
+		uint32_t left;
+		std::vector<uint32_t> right;
+	};
+
+	struct conflict {
+		uint32_t a, b;		// 两个终结符
+		int old_rel, new_rel;
+	};
+
+private:
+	std::vector<uint32_t> terms;		// 终结符，下标就是它的编号
+	std::vector<int> term_index;		// 符号编号到终结符编号，不是终结符时为 -1
+	std::vector<int> nt_index;			// 符号编号到非终结符编号
+	size_t n;
+	std::vector<int8_t> rel;			// n * n 的关系表
+	std::vector<uint64_t> blank;		// 没有关系的项
+	std::vector<int> f, g;
+	bool functions;
+	std::vector<conflict> conflicts;
+
+	int lookup(const std::vector<int>& index, uint32_t sym) const {
+		return sym < index.size() ? index[sym] : -1;
+	}
+
+	void set(int a, int b, int r) {
+		int8_t& cur = rel[a * n + b];
+		if ( cur != prec_none && cur != r )
+			conflicts.push_back({terms[a], terms[b], cur, r});
+		else
+			cur = r;
+	}
+
+	// 求 f / g：f(a) 和 g(b) 是图中的结点，= 的两端合并成一个结点，
+	// a > b 连边 f(a) -> g(b)，a < b 连边 g(b) -> f(a)，函数值是从该结点出发的最长路径长度
+	bool build_functions();
+
+public:
+	precedence_table() : n(0), functions(false) {}
+
+	// 由文法生成关系表，start 是开始符号，end 是句子两端的界符 #
+	void build(const std::vector<production>& grammar, uint32_t start, uint32_t end);
+
+	size_t size() const { return n; }
+	uint32_t terminal(int k) const { return terms[k]; }
+	int index(uint32_t sym) const { return lookup(term_index, sym); }
+	bool is_terminal(uint32_t sym) const { return index(sym) >= 0; }
+	bool is_nonterminal(uint32_t sym) const { return lookup(nt_index, sym) >= 0; }
+	bool has_functions() const { return functions; }
+	const std::vector<conflict>& conflict_list() const { return conflicts; }
+	int f_value(int a) const { return f[a]; }
+	int g_value(int b) const { return g[b]; }
+
+	// 两个终结符之间的关系
+	int relation(int a, int b) const {
+		size_t k = a * n + b;
+		if ( blank[k >> 6] >> (k & 63) & 1 ) return prec_none;
+		if ( functions ) return f[a] < g[b] ? prec_less : f[a] > g[b] ? prec_greater : prec_equal;
+		return rel[k];
+	}
+};
+
+inline void precedence_table::build(const std::vector<production>& grammar, uint32_t start, uint32_t end) {
+	terms.clear(), term_index.clear(), nt_index.clear(), conflicts.clear();
+	uint32_t max_sym = std::max(start, end);
+	for ( const production& p : grammar ) {
+		max_sym = std::max(max_sym, p.left);
+		for ( uint32_t s : p.right ) max_sym = std::max(max_sym, s);
+	}
+	term_index.assign(max_sym + 1, -1);
+	nt_index.assign(max_sym + 1, -1);
+	size_t m = 0;
+	for ( const production& p : grammar )
+		if ( nt_index[p.left] < 0 ) nt_index[p.left] = m++;
+	auto add_term = [&](uint32_t s) {
+		if ( nt_index[s] < 0 && term_index[s] < 0 ) {
+			term_index[s] = terms.size();
+			terms.emplace_back(s);
+		}
+	};
+	for ( const production& p : grammar )
+		for ( uint32_t s : p.right ) add_term(s);
+	add_term(end);
+	n = terms.size();
+
+	// 拓广文法 S' -> # S #
+	std::vector<production> all = grammar;
+	all.push_back({uint32_t(max_sym + 1), {end, start, end}});
+	nt_index.emplace_back(m++);
+
+	// FIRSTVT / LASTVT，反复传播直到不再变化
+	std::vector<std::vector<char>> first(m, std::vector<char>(n)), last(m, std::vector<char>(n));
+	auto nt = [&](uint32_t s) { return nt_index[s]; };
+	auto tm = [&](uint32_t s) { return s < term_index.size() ? term_index[s] : -1; };
+	for ( bool changed = true; changed; ) {
+		changed = false;
+		auto merge = [&](std::vector<char>& to, const std::vector<char>& from) {
+			for ( size_t a = 0; a < n; ++a )
+				if ( from[a] && !to[a] ) to[a] = 1, changed = true;
+		};
+		auto mark = [&](std::vector<char>& to, int a) {
+			if ( !to[a] ) to[a] = 1, changed = true;
+		};
+		for ( const production& p : all ) {
+			const std::vector<uint32_t>& r = p.right;
+			size_t k = r.size();
+			if ( k == 0 ) continue;
+			// P -> a... 或 P -> Qa...
+			if ( tm(r[0]) >= 0 ) mark(first[nt(p.left)], tm(r[0]));
+			else {
+				merge(first[nt(p.left)], first[nt(r[0])]);
+				if ( k > 1 && tm(r[1]) >= 0 ) mark(first[nt(p.left)], tm(r[1]));
+			}
+			// P -> ...a 或 P -> ...aQ
+			if ( tm(r[k - 1]) >= 0 ) mark(last[nt(p.left)], tm(r[k - 1]));
+			else {
+				merge(last[nt(p.left)], last[nt(r[k - 1])]);
+				if ( k > 1 && tm(r[k - 2]) >= 0 ) mark(last[nt(p.left)], tm(r[k - 2]));
+			}
+		}
+	}
+
+	rel.assign(n * n, prec_none);
+	for ( const production& p : all ) {
+		const std::vector<uint32_t>& r = p.right;
+		for ( size_t i = 0; i + 1 < r.size(); ++i ) {
+			int a = tm(r[i]), b = tm(r[i + 1]);
+			if ( a >= 0 && b >= 0 ) set(a, b, prec_equal);
+			if ( a >= 0 && b < 0 ) {
+				if ( i + 2 < r.size() && tm(r[i + 2]) >= 0 ) set(a, tm(r[i + 2]), prec_equal);
+				for ( size_t c = 0; c < n; ++c )
+					if ( first[nt(r[i + 1])][c] ) set(a, c, prec_less);
+			}
+			if ( a < 0 && b >= 0 ) {
+				for ( size_t c = 0; c < n; ++c )
+					if ( last[nt(r[i])][c] ) set(c, b, prec_greater);
+			}
+		}
+	}
+	// S' 只在构造时使用，它的编号以后会分给新登记的符号
+	nt_index.pop_back();
+	blank.assign((n * n + 63) / 64, 0);
+	for ( size_t k = 0; k < n * n; ++k )
+		if ( rel[k] == prec_none ) blank[k >> 6] |= uint64_t(1) << (k & 63);
+	functions = conflicts.empty() && build_functions();
+}
+
+inline bool precedence_table::build_functions() {
+	// 并查集合并 = 关系的两端
+	std::vector<int> parent(2 * n);
+	for ( size_t i = 0; i < 2 * n; ++i ) parent[i] = i;
+	auto find = [&](int x) {
+		while ( parent[x] != x ) x = parent[x] = parent[parent[x]];
+		return x;
+	};
+	for ( size_t a = 0; a < n; ++a )
+		for ( size_t b = 0; b < n; ++b )
+			if ( rel[a * n + b] == prec_equal ) parent[find(a)] = find(n + b);
+
+	std::vector<std::vector<int>> edges(2 * n);
+	for ( size_t a = 0; a < n; ++a )
+		for ( size_t b = 0; b < n; ++b ) {
+			int r = rel[a * n + b];
+			if ( r == prec_greater ) edges[find(a)].emplace_back(find(n + b));
+			if ( r == prec_less ) edges[find(n + b)].emplace_back(find(a));
+		}
+
+	// 最长路径，图中有环时没有优先函数
+	std::vector<int> len(2 * n, -1), state(2 * n, 0);
+	bool acyclic = true;
+	auto dfs = [&](auto&& self, int v) -> int {
+		if ( state[v] == 2 ) return len[v];
+		if ( state[v] == 1 ) {
+			acyclic = false;
+			return 0;
+		}
+		state[v] = 1;
+		int best = 0;
+		for ( int w : edges[v] ) best = std::max(best, self(self, w) + 1);
+		state[v] = 2;
+		return len[v] = best;
+	};
+	f.assign(n, 0), g.assign(n, 0);
+	for ( size_t a = 0; a < n; ++a ) f[a] = dfs(dfs, find(a));
+	for ( size_t b = 0; b < n; ++b ) g[b] = dfs(dfs, find(n + b));
+	return acyclic;
+}
+
+#endif
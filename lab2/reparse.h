@@ -0,0 +1,260 @@
+#ifndef REPARSE_H
+#define REPARSE_H
+
+#include <cstdint>
+#include <vector>
+#include "parser.h"
+
+using namespace std;
+
+// 增量的表达式分析：长表达式中改了几个单词时只重新分析包含修改的最小子树，其余子树原样保留
+// 语法树本身就是单词的存储：每个结点记着覆盖的单词个数和左子树前的左括号个数，
+// 从根往下按个数就能找到第 i 个单词，不另外保存单词序列，一次修改的代价和树高、改动的大小有关。
+//
+// 一棵子树的单词两边加上 # 单独分析，得到的树和在整个表达式中分析得到的相同，只要
+//   1. 子树中括号外的每个算符 o 都满足 L < o 且 o > R，L、R 是子树左右相邻的单词，
+//      这样子树在两边的算符之前就规约完了；
+//   2. 规约成的非终结符和原来的子树相同，外面的句柄照旧匹配。
+// 括号中的子树总是满足第一条。修改所在的最小子树不满足时换成它的父结点，一直到根，
+// 根就是整个表达式重新分析。
+// 换下来的结点留在池里，池中的结点比单词个数多出很多时整个重新分析一次，把池清空。
+
+class expr_document {
+	parse_workspace w;
+	parse_trace quiet;				// 增量分析不输出过程
+	uint32_t root;
+	size_t count;					// 单词个数
+	vector<uint32_t> flat;			// 分析失败时没有树，单词放在这里
+	vector<uint8_t> flat_numeric;
+	vector<pair<uint32_t, uint32_t>> path;		// (结点, 第一个单词的下标)，从根到修改所在的子树
+	vector<uint32_t> region;
+	vector<uint8_t> region_numeric;
+
+	void emit(uint32_t k, vector<uint32_t>& syms, vector<uint8_t>& numeric) const;
+	uint32_t token_at(size_t i) const;
+	bool bounded(uint32_t left, uint32_t right) const;
+
+	// 分析 w.input 中的整个表达式
+	bool parse_all() {
+		w.ast.reset();
+		w.input.emplace_back(end_sym);
+		w.numeric.emplace_back(0);
+		root = parse_input(w, quiet);
+		if(root != ast_null) {
+			fold_constants(w.ast);
+			flat.clear();
+			flat_numeric.clear();
+			return true;
+		}
+		flat.assign(w.input.begin(), w.input.end() - 1);
+		flat_numeric.assign(w.numeric.begin(), w.numeric.end() - 1);
+		return false;
+	}
+
+public:
+	struct statistics {
+		size_t reparsed;			// 重新分析的单词个数
+		size_t widened;				// 从修改所在的最小子树往上换了几次
+	};
+	statistics last;				// 最近一次修改
+
+	expr_document() : root(ast_null), count(0), last{0, 0} { quiet.set_level(trace_none); }
+
+	// 换掉整个表达式并从头分析，numeric[i] 表示第 i 个单词是不是数
+	bool assign(const uint32_t* syms, const uint8_t* numeric, size_t n) {
+		w.input.assign(syms, syms + n);
+		w.numeric.assign(numeric, numeric + n);
+		count = n;
+		last = {n, 0};
+		return parse_all();
+	}
+
+	// 把第 i 到第 j 个（不含）单词换成 syms[0, m)，返回修改之后整个表达式能否分析
+	bool edit(size_t i, size_t j, const uint32_t* syms, const uint8_t* numeric, size_t m);
+
+	bool ok() const { return root != ast_null; }
+	size_t size() const { return count; }
+	uint32_t tree() const { return root; }			// 语法树的根，分析失败时为 ast_null
+	const ast_pool& nodes() const { return w.ast; }
+
+	// 整个表达式的单词
+	void tokens(vector<uint32_t>& syms, vector<uint8_t>& numeric) const {
+		syms.clear();
+		numeric.clear();
+		if(root == ast_null) {
+			syms = flat;
+			numeric = flat_numeric;
+		}
+		else
+			emit(root, syms, numeric);
+	}
+};
+
+// 把子树 k 覆盖的单词追加到 syms 后面，用显式的栈
+inline void expr_document::emit(uint32_t k, vector<uint32_t>& syms, vector<uint8_t>& numeric) const {
+	// 第二个分量：0 刚进入，1 左子树已输出，2 右子树已输出
+	vector<pair<uint32_t, int>> stack;
+	stack.emplace_back(k, 0);
+	while(!stack.empty()) {
+		auto& top = stack.back();
+		const ast_node& node = w.ast[top.first];
+		if(top.second == 0) {
+			syms.insert(syms.end(), node.lead, lparen_sym);
+			numeric.insert(numeric.end(), node.lead, 0);
+			if(node.left != ast_null) {
+				top.second = 1;
+				stack.emplace_back(node.left, 0);
+				continue;
+			}
+			syms.emplace_back(node.sym);
+			numeric.emplace_back(node.kind == ast_number);
+		}
+		else if(top.second == 1) {
+			syms.emplace_back(node.sym);
+			numeric.emplace_back(0);
+			top.second = 2;
+			stack.emplace_back(node.right, 0);
+			continue;
+		}
+		// 右边的括号
+		uint32_t inner = node.left == ast_null ? 1 : w.ast[node.left].width + 1 + w.ast[node.right].width;
+		syms.insert(syms.end(), node.width - node.lead - inner, rparen_sym);
+		numeric.insert(numeric.end(), node.width - node.lead - inner, 0);
+		stack.pop_back();
+	}
+}
+
+// 第 i 个单词，在表达式之外时是 #
+inline uint32_t expr_document::token_at(size_t i) const {
+	if(i >= count)
+		return end_sym;
+	uint32_t k = root;
+	size_t start = 0;
+	for(;;) {
+		const ast_node& node = w.ast[k];
+		size_t b = start + node.lead;
+		if(i < b)
+			return lparen_sym;
+		if(node.left == ast_null)
+			return i == b ? node.sym : rparen_sym;
+		const ast_node& l = w.ast[node.left];
+		const ast_node& r = w.ast[node.right];
+		if(i < b + l.width)
+			k = node.left, start = b;
+		else if(i == b + l.width)
+			return node.sym;
+		else if(i < b + l.width + 1 + r.width)
+			k = node.right, start = b + l.width + 1;
+		else
+			return rparen_sym;
+	}
+}
+
+// region 中括号外的算符都比左右相邻的单词优先，括号也配对
+inline bool expr_document::bounded(uint32_t left, uint32_t right) const {
+	int depth = 0;
+	for(uint32_t sym : region) {
+		if(sym == lparen_sym)
+			++depth;
+		else if(sym == rparen_sym) {
+			if(--depth < 0)
+				return false;
+		}
+		else if(depth == 0 && is_operator(sym) && sym != i_sym && sym != end_sym) {
+			if(prec.relation(id(left), id(sym)) != prec_less || prec.relation(id(sym), id(right)) != prec_greater)
+				return false;
+		}
+	}
+	return depth == 0;
+}
+
+inline bool expr_document::edit(size_t i, size_t j, const uint32_t* syms, const uint8_t* numeric, size_t m) {
+	j = min(j, count);
+	i = min(i, j);
+	ptrdiff_t delta = ptrdiff_t(m) - ptrdiff_t(j - i);
+	if(root == ast_null) {
+		flat.erase(flat.begin() + i, flat.begin() + j);
+		flat.insert(flat.begin() + i, syms, syms + m);
+		flat_numeric.erase(flat_numeric.begin() + i, flat_numeric.begin() + j);
+		flat_numeric.insert(flat_numeric.begin() + i, numeric, numeric + m);
+		w.input.swap(flat);
+		w.numeric.swap(flat_numeric);
+		count = w.input.size();
+		last = {count, 0};
+		return parse_all();
+	}
+
+	// 从根往下找覆盖 [i, j) 的最小子树
+	path.clear();
+	uint32_t k = root;
+	size_t start = 0;
+	for(;;) {
+		path.emplace_back(k, uint32_t(start));
+		const ast_node& node = w.ast[k];
+		if(node.left == ast_null)
+			break;
+		size_t b = start + node.lead;
+		size_t rs = b + w.ast[node.left].width + 1;
+		if(b <= i && j <= rs - 1)
+			k = node.left, start = b;
+		else if(rs <= i && j <= rs + w.ast[node.right].width)
+			k = node.right, start = rs;
+		else
+			break;
+	}
+
+	// 由内往外试，能单独分析的第一棵子树就换成新分析的结果
+	for(size_t d = path.size(); d-- > 0; ) {
+		uint32_t old = path[d].first;
+		size_t s = path[d].second;
+		region.clear();
+		region_numeric.clear();
+		emit(old, region, region_numeric);
+		region.erase(region.begin() + (i - s), region.begin() + (j - s));
+		region.insert(region.begin() + (i - s), syms, syms + m);
+		region_numeric.erase(region_numeric.begin() + (i - s), region_numeric.begin() + (j - s));
+		region_numeric.insert(region_numeric.begin() + (i - s), numeric, numeric + m);
+		if(d == 0) {
+			// 根：整个表达式重新分析
+			w.input.swap(region);
+			w.numeric.swap(region_numeric);
+			count = w.input.size();
+			last = {count, path.size() - 1};
+			return parse_all();
+		}
+		if(!bounded(token_at(s - 1), token_at(s + w.ast[old].width)))
+			continue;
+
+		uint32_t mark = w.ast.size();
+		w.input.assign(region.begin(), region.end());
+		w.numeric.assign(region_numeric.begin(), region_numeric.end());
+		w.input.emplace_back(end_sym);
+		w.numeric.emplace_back(0);
+		uint32_t sub = parse_input(w, quiet);
+		if(sub == ast_null || w.ast[sub].nt != w.ast[old].nt)
+			continue;
+		fold_constants(w.ast, mark);
+
+		// 接到父结点上，祖先覆盖的单词个数加上 delta，再重新折叠
+		ast_node& parent = w.ast[path[d - 1].first];
+		(parent.left == old ? parent.left : parent.right) = sub;
+		for(size_t a = d; a-- > 0; ) {
+			w.ast[path[a].first].width += delta;
+			refold(w.ast, path[a].first);
+		}
+		count += delta;
+		last = {region.size(), path.size() - 1 - d};
+
+		// 换下来的结点太多时整个重新分析一次
+		if(w.ast.size() > 4 * count + 4096) {
+			w.input.clear();
+			w.numeric.clear();
+			emit(root, w.input, w.numeric);
+			return parse_all();
+		}
+		return true;
+	}
+	return false;
+}
+
+#endif
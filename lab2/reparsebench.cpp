@@ -0,0 +1,144 @@
+// 增量表达式分析的基准测试
+// 生成一个很长的表达式，反复把其中随机的一个运算对象换成有 k 个运算对象的子表达式，
+// 再换回来，统计每次修改的耗时和重新分析的单词数，与整个表达式从头分析比较。
+// 每种大小测完都和从头分析得到的语法树核对一次。
+// 用法: reparsebench [--operands N] [--edits N]
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "reparse.h"
+
+using namespace std;
+typedef chrono::steady_clock timer;
+
+double micros(timer::time_point a, timer::time_point b) {
+	return chrono::duration<double, micro>(b - a).count();
+}
+
+mt19937 rng(12345);
+vector<uint32_t> operands;		// 运算对象的符号
+uint32_t plus_sym, minus_sym, times_sym;
+
+// 生成时栈中的一项：n 为 0 时输出符号 sym，否则是有 n 个运算对象的子表达式，
+// 它的算符级别低于 level 时要加括号
+struct pending {
+	size_t n;
+	uint32_t sym;
+	int level;
+};
+
+// 有 n 个运算对象的平衡表达式，加减乘随机，只在改变结合次序时加括号。
+// level 为 3 时整个表达式一定加括号（单独的运算对象不加），可以用来替换一个运算对象
+void generate(size_t n, vector<uint32_t>& out, int level = 0) {
+	vector<pending> todo(1, {n, 0, level});
+	while(!todo.empty()) {
+		pending p = todo.back();
+		todo.pop_back();
+		if(p.n == 0) {
+			out.emplace_back(p.sym);
+			continue;
+		}
+		if(p.n == 1) {
+			out.emplace_back(operands[rng() % operands.size()]);
+			continue;
+		}
+		size_t a = 1 + rng() % (p.n - 1);
+		uint32_t op = rng() % 3 == 0 ? times_sym : rng() % 2 ? plus_sym : minus_sym;
+		int l = op == times_sym ? 2 : 1;
+		if(l < p.level) {
+			out.emplace_back(lparen_sym);
+			todo.push_back({0, rparen_sym, 0});
+		}
+		// 左结合：右运算对象是同级运算时也要加括号
+		todo.push_back({p.n - a, 0, l + 1});
+		todo.push_back({0, op, 0});
+		todo.push_back({a, 0, l});
+	}
+}
+
+bool is_operand(uint32_t sym) {
+	return sym != lparen_sym && sym != rparen_sym && sym != plus_sym && sym != minus_sym && sym != times_sym;
+}
+
+int main(int argc, char* argv [ ]) {
+	size_t n = 1 << 17, edits = 2000;
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if(arg == "--operands" && i + 1 < argc) n = stoul(argv[++i]);
+		else if(arg == "--edits" && i + 1 < argc) edits = stoul(argv[++i]);
+	}
+	grammer_init();
+	trace.set_level(trace_none);
+	plus_sym = symbols.intern("+");
+	minus_sym = symbols.intern("-");
+	times_sym = symbols.intern("*");
+	// i 是文法中的终结符，不用它作变量名
+	for(int i = 0; i < 26; ++i)
+		if('a' + i != 'i')
+			operands.emplace_back(symbols.intern(string(1, char('a' + i))));
+
+	vector<uint32_t> expr;
+	generate(n, expr);
+	vector<uint8_t> numeric(expr.size(), 0);
+	vector<size_t> positions;		// 运算对象的位置，每次修改都会换回原样，位置不变
+	for(size_t i = 0; i < expr.size(); ++i)
+		if(is_operand(expr[i]))
+			positions.emplace_back(i);
+
+	expr_document doc;
+	double full = 1e300;
+	for(int r = 0; r < 5; ++r) {
+		auto t0 = timer::now();
+		doc.assign(expr.data(), numeric.data(), expr.size());
+		full = min(full, micros(t0, timer::now()));
+	}
+	if(!doc.ok()) {
+		cout << "cannot parse the generated expression" << cr;
+		return 1;
+	}
+	cout << expr.size() << " tokens, full parse " << full << " us" << cr;
+
+	for(size_t k = 1; k <= 4096; k *= 4) {
+		double total = 0;
+		size_t reparsed = 0, size = 0;
+		for(size_t e = 0; e < edits; ++e) {
+			size_t at = positions[rng() % positions.size()];
+			uint32_t old = expr[at];
+			vector<uint32_t> sub;
+			generate(k, sub, 3);
+			vector<uint8_t> sub_numeric(sub.size(), 0);
+			uint8_t zero = 0;
+
+			auto t0 = timer::now();
+			bool ok = doc.edit(at, at + 1, sub.data(), sub_numeric.data(), sub.size());
+			auto t1 = timer::now();
+			reparsed += doc.last.reparsed;
+			ok = ok && doc.edit(at, at + sub.size(), &old, &zero, 1);
+			auto t2 = timer::now();
+			reparsed += doc.last.reparsed;
+			if(!ok) {
+				cout << "edit failed" << cr;
+				return 1;
+			}
+			total += micros(t0, t1) + micros(t1, t2);
+			size += sub.size();
+		}
+		cout << "edit " << size / edits << " tokens: " << total / (2 * edits) << " us/edit, "
+			 << double(reparsed) / (2 * edits) << " tokens reparsed/edit, "
+			 << full / (total / (2 * edits)) << "x faster than full" << cr;
+
+		// 和从头分析的结果核对
+		string a, b;
+		expr_document fresh;
+		fresh.assign(expr.data(), numeric.data(), expr.size());
+		ast_to_string(doc.nodes(), doc.tree(), symbols, a);
+		ast_to_string(fresh.nodes(), fresh.tree(), symbols, b);
+		if(a != b) {
+			cout << "MISMATCH after edits of " << k << " operands" << cr;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// 单生产者单消费者无锁环形队列
+// 生产者攒够 batch 个元素才发布一次 tail，消费者读完 batch 个元素才归还一次 head，
+// 两边各自缓存对方的位置，大部分操作不碰共享的缓存行。
+// 一方要等待之前先把自己手里未发布的部分发布出去，所以不会互相等死。
+template<class T>
+class spsc_ring {
+	std::vector<T> slots;
+	size_t mask, batch;
+
+	alignas(64) std::atomic<size_t> head;		// 消费者已归还的位置
+	alignas(64) std::atomic<size_t> tail;		// 生产者已发布的位置
+	alignas(64) std::atomic<bool> closed;
+
+	// 生产者私有
+	alignas(64) size_t write_pos;
+	size_t head_cache, published;
+
+	// 消费者私有
+	alignas(64) size_t read_pos;
+	size_t tail_cache, released;
+
+public:
+	// 容量向上取到 2 的幂
+	explicit spsc_ring(size_t capacity = 1 << 16, size_t _batch = 64) {
+		size_t cap = 1;
+		while ( cap < capacity ) cap <<= 1;
+		slots.resize(cap);
+		mask = cap - 1;
+		batch = _batch < cap ? _batch : cap;
+		head = 0, tail = 0, closed = false;
+		write_pos = head_cache = published = 0;
+		read_pos = tail_cache = released = 0;
+	}
+	spsc_ring(const spsc_ring&) = delete;
+	spsc_ring& operator = (const spsc_ring&) = delete;
+
+	// 生产者：放入一个元素，队列满时等待
+	void push(const T& v) {
+		if ( write_pos - head_cache > mask ) {
+			flush();
+			while ( write_pos - (head_cache = head.load(std::memory_order_acquire)) > mask )
+				std::this_thread::yield();
+		}
+		slots[write_pos & mask] = v;
+		++write_pos;
+		if ( write_pos - published >= batch ) flush();
+	}
+
+	// 生产者：发布所有已放入的元素
+	void flush() {
+		published = write_pos;
+		tail.store(write_pos, std::memory_order_release);
+	}
+
+	// 生产者：不再放入元素
+	void close() {
+		flush();
+		closed.store(true, std::memory_order_release);
+	}
+
+	// 消费者：取出一个元素，队列空时等待，已关闭且取空时返回 false
+	bool pop(T& v) {
+		if ( read_pos == tail_cache ) {
+			release();
+			while ( read_pos == (tail_cache = tail.load(std::memory_order_acquire)) ) {
+				if ( closed.load(std::memory_order_acquire) ) {
+					tail_cache = tail.load(std::memory_order_acquire);
+					if ( read_pos == tail_cache ) return false;
+					break;
+				}
+				std::this_thread::yield();
+			}
+		}
+		v = slots[read_pos & mask];
+		++read_pos;
+		if ( read_pos - released >= batch ) release();
+		return true;
+	}
+
+	// 消费者：归还已经取出的位置
+	void release() {
+		released = read_pos;
+		head.store(read_pos, std::memory_order_release);
+	}
+};
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../lab1/symbol_table.h"
+#include "../lab1/hotpath.h"
+
+using namespace std;
+
+// 分析过程的输出
+//   none     不输出
+//   summary  每个表达式只输出表达式和结果
+//   full     输出每一步的符号栈、输入串、操作和规约式
+// 符号栈和输入串的文本随分析增量维护，每一步不用重新拼接；输出先攒在缓冲区里成块写出。
+// 另外可以写一份紧凑的二进制跟踪，由 tracefmt 回放成和 full 相同的文本。
+//
+// 二进制跟踪格式，整数都是小端序：
+//   "TRCB" 版本号 u32
+//   若干事件，每个事件一个字节的标记加上各自的参数
+//   符号名：个数 u32，每个名字是长度 u32 加字节，按编号顺序
+//   符号名在文件中的偏移 u64
+
+enum trace_level { trace_none, trace_summary, trace_full };
+
+const char trace_magic[4] = {'T', 'R', 'C', 'B'};
+const uint32_t trace_format_version = 1;
+
+// 操作
+enum trace_action { act_shift, act_reduce, act_shift_reduce };
+
+class parse_trace {
+	// 二进制跟踪中的事件
+	enum event : uint8_t { ev_begin = 'E', ev_row = 'W', ev_action = 'A', ev_shift = 'S', ev_reduce = 'R',
+		ev_end_row = 'N', ev_finish = 'F', ev_fail = 'X' };
+
+	static const size_t flush_size = 1 << 16;
+
+	trace_level level;
+	const symbol_table* symbols;
+	ostream* os;
+	string out;					// 文本输出缓冲
+	ofstream bin;
+	string bin_out;				// 二进制输出缓冲
+	uint64_t bin_size;
+
+	// 当前表达式
+	vector<uint32_t> input;
+	string input_text;
+	vector<size_t> input_begin;	// 每个输入符号在 input_text 中的起点
+	size_t p;
+	string stack_text;
+	vector<size_t> stack_end;	// 每个栈中符号在 stack_text 中的终点
+
+	// 与 left << setw(width) 相同：不足 width 字节时补空格
+	void pad(string_view s, size_t width) {
+		out += s;
+		if ( s.size() < width ) out.append(width - s.size(), ' ');
+	}
+
+	void push(uint32_t sym) {
+		stack_text += symbols->name(sym);
+		stack_end.emplace_back(stack_text.size());
+	}
+
+	void put(uint32_t v) { bin_out.append((const char*)&v, 4); }
+	void put_event(event e) { bin_out += char(e); }
+
+	void flush_text() {
+		if ( !out.empty() ) os->write(out.data(), out.size());
+		out.clear();
+	}
+
+	void flush_binary() {
+		if ( !bin.is_open() ) return;
+		bin.write(bin_out.data(), bin_out.size());
+		bin_size += bin_out.size();
+		bin_out.clear();
+	}
+
+	void written() {
+		if ( out.size() >= flush_size ) flush_text();
+		if ( bin_out.size() >= flush_size ) flush_binary();
+	}
+
+	bool text() const { return level == trace_full; }
+
+	void failed() {
+		if ( level == trace_none ) return;
+		if ( text() ) out += '\n';
+		out += "规约失败\n";
+	}
+
+public:
+	parse_trace() : level(trace_full), symbols(nullptr), os(&cout), bin_size(0), p(0) {}
+	~parse_trace() { close(); }
+
+	void set_level(trace_level _level) { level = _level; }
+	trace_level get_level() const { return level; }
+	bool needs_rules() const { return level == trace_full || bin.is_open(); }	// 要不要给出规约式的右部
+	void set_symbols(const symbol_table& s) { symbols = &s; }
+	void set_output(ostream& _os) {
+		flush_text();
+		os = &_os;
+	}
+
+	bool open_binary(const string& path) {
+		bin.open(path, ios::out | ios::binary);
+		if ( !bin ) return false;
+		bin_out.assign(trace_magic, 4);
+		put(trace_format_version);
+		bin_size = 0;
+		return true;
+	}
+
+	// 写出缓冲区中的文本和二进制跟踪
+	void flush() {
+		flush_text();
+		flush_binary();
+		os->flush();
+	}
+
+	// 结束二进制跟踪，写出符号名
+	void close() {
+		flush();
+		if ( !bin.is_open() ) return;
+		uint64_t names_at = bin_size;
+		put(symbols->size());
+		for ( uint32_t i = 0; i < symbols->size(); ++i ) {
+			string_view name = symbols->name(i);
+			put(name.size());
+			bin_out += name;
+		}
+		bin_out.append((const char*)&names_at, 8);
+		flush_binary();
+		bin.close();
+	}
+
+	// 开始一个表达式，input 不含结尾的 #
+	void begin(const uint32_t* syms, size_t n, uint32_t end) {
+		HOT_SCOPE(hp_trace);
+		if ( bin.is_open() ) {
+			put_event(ev_begin);
+			put(n), put(end);
+			for ( size_t i = 0; i < n; ++i ) put(syms[i]);
+		}
+		if ( level == trace_none ) return;
+		out.append(50, '-');
+		out += '\n';
+		out += "表达式: ";
+		input.assign(syms, syms + n);
+		input_text.clear();
+		input_begin.clear();
+		for ( uint32_t sym : input ) {
+			input_begin.emplace_back(input_text.size());
+			input_text += symbols->name(sym);
+		}
+		out += input_text;
+		out += '\n';
+		input.emplace_back(end);
+		input_begin.emplace_back(input_text.size());
+		input_text += symbols->name(end);
+		p = 0;
+		stack_text.clear();
+		stack_end.clear();
+		push(end);
+		if ( text() ) {
+			pad("符号栈", 20);
+			pad("输入串", 20);
+			pad("操作", 16);
+			pad("规约式", 20);
+			out += '\n';
+		}
+		written();
+	}
+
+	// 一步开始，输出符号栈和剩余的输入串
+	void row() {
+		HOT_SCOPE(hp_trace);
+		if ( bin.is_open() ) put_event(ev_row);
+		if ( !text() ) return;
+		pad(stack_text, 17);
+		pad(string_view(input_text).substr(input_begin[p]), 17);
+	}
+
+	void action(trace_action a) {
+		HOT_SCOPE(hp_trace);
+		if ( bin.is_open() ) put_event(ev_action), bin_out += char(a);
+		if ( !text() ) return;
+		if ( a == act_shift ) pad("移进", 10);
+		else if ( a == act_reduce ) pad("规约", 16);
+		else pad("移进规约", 18);
+	}
+
+	// 移进下一个输入符号
+	void shift() {
+		HOT_SCOPE(hp_trace);
+		if ( bin.is_open() ) put_event(ev_shift);
+		if ( level == trace_none ) return;
+		push(input[p++]);
+	}
+
+	// 把栈中 start 以上的句柄规约成 left，rule 是句柄对应的产生式右部
+	void reduce(size_t start, uint32_t left, const uint32_t* rule, size_t k) {
+		HOT_SCOPE(hp_trace);
+		if ( bin.is_open() ) {
+			put_event(ev_reduce);
+			put(start), put(left), put(k);
+			for ( size_t i = 0; i < k; ++i ) put(rule[i]);
+		}
+		if ( level == trace_none ) return;
+		stack_text.resize(start ? stack_end[start - 1] : 0);
+		stack_end.resize(start);
+		push(left);
+		if ( !text() ) return;
+		size_t from = out.size();
+		out += symbols->name(left);
+		out += "->";
+		for ( size_t i = 0; i < k; ++i ) out += symbols->name(rule[i]);
+		if ( out.size() - from < 20 ) out.append(20 - (out.size() - from), ' ');
+	}
+
+	void end_row() {
+		HOT_SCOPE(hp_trace);
+		if ( bin.is_open() ) put_event(ev_end_row);
+		if ( !text() ) return;
+		out += '\n';
+		written();
+	}
+
+	// 输入读完，ok 表示栈中只剩开始符号
+	void finish(bool ok) {
+		HOT_SCOPE(hp_trace);
+		if ( bin.is_open() ) put_event(ev_finish), bin_out += char(ok);
+		if ( text() ) {
+			pad(stack_text, 18);
+			out += '\n';
+		}
+		if ( ok && level != trace_none ) out += "规约成功\n";
+		if ( !ok ) failed();
+		written();
+	}
+
+	void fail() {
+		HOT_SCOPE(hp_trace);
+		if ( bin.is_open() ) put_event(ev_fail);
+		failed();
+		written();
+	}
+
+	// 不论级别，直接输出一行
+	void print(string_view line) {
+		out += line;
+		out += '\n';
+		written();
+	}
+
+	// 回放二进制跟踪，按当前级别输出
+	bool replay(const string& path, symbol_table& names);
+};
+
+// 事件只能读到符号名表之前，符号名只能读到文件尾的偏移之前。
+// 每个事件都按当前的栈深和剩余输入检查：规约的起点不能超出栈，不能移进输入之外的符号，
+// 符号编号都要在名表之内，遇到不合法的事件就停下返回 false，不会越界读写
+inline bool parse_trace::replay(const string& path, symbol_table& names) {
+	ifstream ifs = ifstream(path, ios::in | ios::binary);
+	string data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+	uint32_t version;
+	uint64_t names_at;
+	if ( data.size() < 16 || memcmp(data.data(), trace_magic, 4) != 0 ) return false;
+	memcpy(&version, data.data() + 4, 4);
+	memcpy(&names_at, data.data() + data.size() - 8, 8);
+	if ( version != trace_format_version || names_at < 8 || names_at > data.size() - 12 ) return false;
+
+	size_t pos = names_at, limit = data.size() - 8;
+	auto get = [&](uint32_t& v) {
+		if ( pos + 4 > limit ) return false;
+		memcpy(&v, data.data() + pos, 4);
+		pos += 4;
+		return true;
+	};
+	uint32_t count, len;
+	if ( !get(count) ) return false;
+	for ( uint32_t i = 0; i < count; ++i ) {
+		if ( !get(len) || len > limit - pos ) return false;
+		if ( names.intern(string_view(data.data() + pos, len)) != i ) return false;
+		pos += len;
+	}
+	set_symbols(names);
+
+	pos = 8;
+	limit = names_at;
+	vector<uint32_t> syms;
+	auto get_symbols = [&](uint32_t n) {
+		if ( n > (limit - pos) / 4 ) return false;
+		syms.resize(n);
+		for ( uint32_t i = 0; i < n; ++i )
+			if ( !get(syms[i]) || syms[i] >= count ) return false;
+		return true;
+	};
+	bool begun = false;
+	size_t depth = 0, inputs = 0, shifted = 0;		// 栈深，输入符号个数（含 #），已经移进的个数
+	while ( pos < limit ) {
+		uint8_t e = data[pos++];
+		if ( (e == ev_action || e == ev_finish) && pos >= limit ) return false;
+		if ( e != ev_begin && !begun ) return false;
+		uint32_t n, a, b;
+		switch ( e ) {
+		case ev_begin:
+			if ( !get(n) || !get(a) || a >= count || !get_symbols(n) ) return false;
+			begin(syms.data(), n, a);
+			begun = true;
+			depth = 1, inputs = size_t(n) + 1, shifted = 0;
+			break;
+		case ev_row:
+			if ( shifted >= inputs ) return false;
+			row();
+			break;
+		case ev_action: action(trace_action(data[pos++])); break;
+		case ev_shift:
+			if ( shifted >= inputs ) return false;
+			shift();
+			++shifted, ++depth;
+			break;
+		case ev_reduce:
+			if ( !get(a) || !get(b) || !get(n) || a > depth || b >= count || !get_symbols(n) ) return false;
+			reduce(a, b, syms.data(), n);
+			depth = size_t(a) + 1;
+			break;
+		case ev_end_row: end_row(); break;
+		case ev_finish: finish(data[pos++]); break;
+		case ev_fail: fail(); break;
+		default: return false;
+		}
+	}
+	flush();
+	return true;
+}
+
+#endif
@@ -0,0 +1,23 @@
+// 把 parser 写出的二进制跟踪回放成文本
+// 用法: tracefmt 跟踪文件 [--summary]
+#include <iostream>
+#include "trace.h"
+
+using namespace std;
+
+int main(int argc, char* argv [ ]) {
+	if(argc < 2) {
+		cout << "usage: tracefmt trace [--summary]" << '\n';
+		return 1;
+	}
+	parse_trace trace;
+	if(argc > 2 && string(argv[2]) == "--summary")
+		trace.set_level(trace_summary);
+	symbol_table names;
+	if(!trace.replay(argv[1], names)) {
+		trace.flush();		// 先写出坏事件之前回放出的部分
+		cout << "Invalid trace file " << argv[1] << '\n';
+		return 1;
+	}
+	return 0;
+}